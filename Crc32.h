@@ -6,6 +6,8 @@
 // see http://create.stephan-brumme.com/disclaimer.html
 //
 
+#pragma once
+
 // if running on an embedded system, you might consider shrinking the
 // big Crc32Lookup table by undefining these lines:
 #define CRC32_USE_LOOKUP_TABLE_BYTE
@@ -19,21 +21,234 @@
 // - crc32_4bytes   needs only Crc32Lookup[0..3]
 // - crc32_8bytes   needs only Crc32Lookup[0..7]
 // - crc32_4x8bytes needs only Crc32Lookup[0..7]
+// - crc32_8bytes_interleaved needs only Crc32Lookup[0..7] (and all of Crc32Lookup for its last bytes if available)
 // - crc32_16bytes  needs all of Crc32Lookup
+// - crc32_pclmul   needs only Crc32Lookup[0..7] (for inputs with less than 16 bytes)
+// - crc32_vpclmul  needs only Crc32Lookup[0..7] (for inputs with less than 16 bytes)
 // using the aforementioned #defines the table is automatically fitted to your needs
 
+// x64 CPUs with carry-less multiplication (Intel Westmere, AMD Bulldozer and newer)
+// process 64 bytes per iteration, undefine if your compiler doesn't know PCLMULQDQ intrinsics
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32_USE_PCLMULQDQ
+// AVX-512 CPUs with VPCLMULQDQ (Intel Ice Lake, AMD Zen 4 and newer) fold 256 bytes per iteration,
+// requires at least GCC 8, Clang 6 or Visual C++ 2019
+#define CRC32_USE_VPCLMULQDQ
+// SSE4.2 has a crc32 instruction, but it only supports Castagnoli's polynomial (CRC-32C)
+#define CRC32_USE_SSE42
+#endif
+// VPCLMULQDQ relies on the CPU detection and folding code of PCLMULQDQ
+#if defined(CRC32_USE_VPCLMULQDQ) && !defined(CRC32_USE_PCLMULQDQ)
+#undef CRC32_USE_VPCLMULQDQ
+#endif
+// the SSE4.2 code shares CPU detection with PCLMULQDQ and merges its three streams with carry-less multiplication
+#if defined(CRC32_USE_SSE42) && !defined(CRC32_USE_PCLMULQDQ)
+#undef CRC32_USE_SSE42
+#endif
+
+// crc32_fast and crc32_parallel can be tuned for a specific machine by a profile file (see Crc32Profile),
+// undefine on systems without a file system or std::atomic (e.g. Arduino)
+#define CRC32_USE_PROFILE
+
 // uint8_t, uint32_t, int32_t
 #include <stdint.h>
 // size_t
 #include <cstddef>
+// memcpy (Crc32::update)
+#include <cstring>
+// crc32_fixed
+#include "Crc32Generic.h"
+
+/// signature shared by all crc32_xxx functions
+typedef uint32_t (*Crc32Function)(const void* data, size_t length, uint32_t previousCrc32);
 
 // crc32_fast selects the fastest algorithm depending on flags (CRC32_USE_LOOKUP_...)
+// and, if SIMD algorithms are enabled, on the CPU's features detected during its first call
+// (or as specified by a profile, see Crc32Profile)
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast    (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// name of the algorithm used by crc32_fast for large inputs, e.g. "carry-less multiplication"
+const char* crc32_fast_algorithm();
+
+#ifdef CRC32_USE_PROFILE
+/// machine-specific settings of crc32_fast and crc32_parallel, measured by Crc32Bench -t
+/// the file named by the environment variable CRC32_PROFILE is loaded before crc32_fast's first call
+struct Crc32Profile
+{
+  /// crc32_fast may pick a different algorithm for inputs with less than 256 bytes, 4 KB, 64 KB and larger inputs
+  enum { NumSizeClasses = 4 };
+  /// inputs of a size class are shorter than this (the last size class is unlimited)
+  static size_t getSizeClassLimit(size_t sizeClass) { return sizeClass + 1 < NumSizeClasses ? size_t(256) << (4 * sizeClass) : ~size_t(0); }
+  /// size class of an input
+  static size_t getSizeClass(size_t length) { return length < 256 ? 0 : length < 4096 ? 1 : length < 65536 ? 2 : 3; }
+
+  /// algorithm of each size class, e.g. "pclmul" (see crc32_algorithm), NULL => built-in choice
+  const char* algorithms[NumSizeClasses];
+  /// look-ahead of crc32_16bytes_prefetch when chosen by crc32_fast, 0 => 256 bytes
+  size_t prefetchAhead;
+  /// crc32_parallel: at most this many bytes per task, 0 => one block per thread
+  size_t parallelBlockSize;
+  /// crc32_parallel: default of Crc32ThreadPool::setMinBlockSize, 0 => 512 KB
+  size_t parallelMinBlockSize;
+};
+
+/// algorithm by name: "bitwise", "halfbyte", "1byte", "tableless", "tableless2", "4bytes", "8bytes", "4x8bytes",
+/// "8bytes_interleaved", "16bytes", "16bytes_prefetch", "pclmul" or "vpclmul", NULL if unknown or not supported by the CPU
+Crc32Function crc32_algorithm(const char* name);
+/// current settings of crc32_fast and crc32_parallel
+Crc32Profile crc32_get_profile();
+/// replace settings of crc32_fast and crc32_parallel (unknown or unsupported algorithms fall back to the built-in choice)
+/// don't call while other threads use crc32_parallel
+void crc32_set_profile(const Crc32Profile& profile);
+/// read a profile written by crc32_save_profile and apply it, false on error (then nothing is changed)
+bool crc32_load_profile(const char* filename);
+/// write a profile as a small text file, false on error
+bool crc32_save_profile(const char* filename, const Crc32Profile& profile);
+#endif
+
+/// compute CRC32 of many short, independent messages: out[i] = crc32_fast(data[i], lengths[i]) for i = 0 .. count-1
+void crc32_batch(const void* const* data, const size_t* lengths, uint32_t* out, size_t count);
+
+/// copy length bytes (source and destination must not overlap) and compute CRC32 of the data in the same pass
+/// nonTemporal = true bypasses the cache while writing (SIMD only), useful for large copies which won't be read soon
+uint32_t crc32_copy    (void* destination, const void* source, size_t length, uint32_t previousCrc32 = 0, bool nonTemporal = false);
+
+/// compute CRC32 of exactly N bytes, e.g. a key or header whose size is known at compile time (Slicing-by-16, fully unrolled)
+template <size_t N>
+uint32_t crc32_fixed(const void* data, uint32_t previousCrc32 = 0)
+{
+  return Crc32Zlib::fixed<N>(data, previousCrc32);
+}
 
 /// merge two CRC32 such that result = crc32(dataB, lengthB, crc32(dataA, lengthA))
 uint32_t crc32_combine (uint32_t crcA, uint32_t crcB, size_t lengthB);
 
+/// append numBytes zero bytes without touching any memory, O(log numBytes)
+/// (prepend zeros to data B: crc32_combine(crc32_zeros(0, numBytes), crcB, lengthB))
+uint32_t crc32_zeros   (uint32_t previousCrc32, size_t numBytes);
+
+/// CRC32 of data after replacing length bytes at offset by newData, given the CRC32 of the original data (totalLength bytes)
+/// only oldData and newData are processed => O(length + log totalLength), offset + length must not exceed totalLength
+uint32_t crc32_update_range(uint32_t oldCrc32, size_t totalLength, size_t offset,
+                            const void* oldData, const void* newData, size_t length);
+
+/// incrementally compute CRC32 of a stream, small fragments are collected and processed in large blocks by crc32_fast
+class Crc32
+{
+public:
+  /// start a new stream, optionally continue with a previous CRC
+  explicit Crc32(uint32_t previousCrc32 = 0);
+
+  /// add data
+  void update(const void* data, size_t length)
+  {
+    // short fragments are only appended to the incomplete block
+    if (length < BlockSize - m_bufferSize)
+    {
+      memcpy(m_buffer + m_bufferSize, data, length);
+      m_bufferSize += length;
+      return;
+    }
+
+    updateBlocks(data, length);
+  }
+  /// CRC32 of all data passed to update() so far (further updates are still allowed)
+  uint32_t finalize() const;
+  /// start a new stream, optionally continue with a previous CRC
+  void reset(uint32_t previousCrc32 = 0);
+
+private:
+  /// complete the incomplete block and process all full blocks
+  void updateBlocks(const void* data, size_t length);
+
+  /// bytes per block, large enough that crc32_fast's setup costs are negligible
+  static const size_t BlockSize = 1024;
+
+  /// CRC32 of all completely processed blocks
+  uint32_t m_crc;
+  /// bytes in m_buffer
+  size_t   m_bufferSize;
+  /// incomplete block, aligned for SIMD loads (without exceeding the default alignment of operator new)
+  alignas(16) uint8_t m_buffer[BlockSize];
+};
+
+/// append a fixed number of zero bytes to CRC32s, much faster than crc32_combine if many blocks share the same size
+class Crc32Shift
+{
+public:
+  /// prepare for merging blocks of numBytes bytes (compute x^(8*numBytes) mod P and a few lookup tables)
+  explicit Crc32Shift(size_t numBytes = 0);
+
+  /// same as crc32_combine(crcA, crcB, numBytes)
+  uint32_t combine(uint32_t crcA, uint32_t crcB) const
+  {
+    return apply(crcA) ^ crcB;
+  }
+
+  /// append numBytes zeros to a CRC32 (without the usual pre- and post-conditioning)
+  uint32_t apply(uint32_t crc) const
+  {
+    return m_table[0][ crc        & 0xFF] ^
+           m_table[1][(crc >>  8) & 0xFF] ^
+           m_table[2][(crc >> 16) & 0xFF] ^
+           m_table[3][ crc >> 24        ];
+  }
+
+  /// shift by the sum of both shifts' lengths
+  Crc32Shift operator+(const Crc32Shift& other) const;
+
+  /// number of bytes
+  size_t getNumBytes() const { return m_numBytes; }
+
+private:
+  /// build lookup tables for m_factor
+  void init();
+
+  /// length of the zero run
+  size_t   m_numBytes;
+  /// x^(8*numBytes) mod P
+  uint32_t m_factor;
+  /// multiply a byte by m_factor, one table per byte position of the CRC
+  uint32_t m_table[4][256];
+};
+
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+/// CRC32 of a sliding window, e.g. for rsync-like delta detection: moving the window by one byte costs two table lookups
+class Crc32Rolling
+{
+public:
+  /// prepare for windows of windowSize bytes (builds a 1 KB lookup table)
+  explicit Crc32Rolling(size_t windowSize);
+
+  /// start with the first windowSize bytes, returns their CRC32
+  uint32_t reset(const void* window);
+
+  /// move window by one byte: outgoing is its first byte, incoming the byte after its end, returns CRC32 of the new window
+  uint32_t roll(uint8_t outgoing, uint8_t incoming)
+  {
+    // append incoming just like crc32_1byte, then remove outgoing's contribution
+    m_register = (m_register >> 8) ^ m_add[(m_register ^ incoming) & 0xFF] ^ m_remove[outgoing];
+    return ~m_register; // same as m_register ^ 0xFFFFFFFF
+  }
+
+  /// CRC32 of the current window
+  uint32_t crc32() const { return ~m_register; }
+
+  /// number of bytes
+  size_t getWindowSize() const { return m_windowSize; }
+
+private:
+  /// number of bytes
+  size_t          m_windowSize;
+  /// CRC of the current window (without post-conditioning)
+  uint32_t        m_register;
+  /// Crc32Lookup[0]
+  const uint32_t* m_add;
+  /// contribution of a byte windowSize bytes before the end of the window
+  uint32_t        m_remove[256];
+};
+#endif
+
 /// compute CRC32 (bitwise algorithm)
 uint32_t crc32_bitwise (const void* data, size_t length, uint32_t previousCrc32 = 0);
 /// compute CRC32 (half-byte algoritm)
@@ -59,6 +274,8 @@ uint32_t crc32_4bytes  (const void* data, size_t length, uint32_t previousCrc32
 uint32_t crc32_8bytes  (const void* data, size_t length, uint32_t previousCrc32 = 0);
 /// compute CRC32 (Slicing-by-8 algorithm), unroll inner loop 4 times
 uint32_t crc32_4x8bytes(const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// compute CRC32 (Slicing-by-8 algorithm), four interleaved lanes merged by Crc32Shift
+uint32_t crc32_8bytes_interleaved(const void* data, size_t length, uint32_t previousCrc32 = 0);
 #endif
 
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
@@ -67,3 +284,47 @@ uint32_t crc32_16bytes (const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 #endif
+
+#ifdef CRC32_USE_PCLMULQDQ
+/// compute CRC32 (carry-less multiplication, CPU must support PCLMULQDQ and SSE4.1)
+uint32_t crc32_pclmul  (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// copy data and compute CRC32 of it (carry-less multiplication, CPU must support PCLMULQDQ and SSE4.1)
+uint32_t crc32_copy_pclmul(void* destination, const void* source, size_t length, uint32_t previousCrc32 = 0, bool nonTemporal = false);
+/// true if the CPU supports crc32_pclmul
+bool crc32_pclmul_supported();
+#endif
+
+#ifdef CRC32_USE_VPCLMULQDQ
+/// compute CRC32 (carry-less multiplication with AVX-512, CPU must support VPCLMULQDQ)
+uint32_t crc32_vpclmul (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// true if the CPU supports crc32_vpclmul
+bool crc32_vpclmul_supported();
+#endif
+
+
+// CRC-32C is based on Castagnoli's polynomial 0x82F63B78 (iSCSI, SCTP, ext4, Btrfs, ...)
+// - crc32c_bitwise doesn't need a lookup table
+// - crc32c_16bytes needs its own table (16 KB), see Crc32Castagnoli in Crc32Generic.h
+
+/// compute CRC-32C using the fastest algorithm for large datasets on modern CPUs
+uint32_t crc32c_fast    (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// name of the algorithm used by crc32c_fast, e.g. "SSE4.2"
+const char* crc32c_fast_algorithm();
+
+/// merge two CRC-32C such that result = crc32c(dataB, lengthB, crc32c(dataA, lengthA))
+uint32_t crc32c_combine (uint32_t crcA, uint32_t crcB, size_t lengthB);
+
+/// compute CRC-32C (bitwise algorithm)
+uint32_t crc32c_bitwise (const void* data, size_t length, uint32_t previousCrc32 = 0);
+
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+/// compute CRC-32C (Slicing-by-16 algorithm)
+uint32_t crc32c_16bytes (const void* data, size_t length, uint32_t previousCrc32 = 0);
+#endif
+
+#ifdef CRC32_USE_SSE42
+/// compute CRC-32C (SSE4.2 crc32 instruction, three interleaved streams, CPU must support SSE4.2 and PCLMULQDQ)
+uint32_t crc32c_sse42   (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// true if the CPU supports crc32c_sse42
+bool crc32c_sse42_supported();
+#endif
@@ -0,0 +1,954 @@
+// //////////////////////////////////////////////////////////
+// Crc32Bench.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// benchmark harness: run each algorithm with many input sizes and alignments, with data in L1 cache (warm)
+// or streamed from DRAM (cold), print median and 99th percentile per call as CSV or JSON
+// optionally with hardware performance counters (Linux only): cycles, instructions, L1D misses, LLC misses, branch misses
+// or interleaved with random hash table lookups to see how much each algorithm's tables slow down other code,
+// or find the best settings of crc32_fast and crc32_parallel for this machine and write them to a profile
+// usage: Crc32Bench [-f csv|json] [-s sizes] [-a alignments] [-i warm|cold|both] [-n samples] [-k kernels] [-c | -w kilobytes]
+//        Crc32Bench -t profile [-n samples]
+
+#include "Crc32.h"
+#include "Crc32Parallel.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+// time stamp counter
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32_BENCH_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// hardware performance counters
+#ifdef __linux__
+#define CRC32_BENCH_PERF_EVENTS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/// cold inputs are taken from a buffer much larger than the last-level cache
+const size_t StreamingBufferSize = 256*1024*1024;
+/// warm inputs never exceed this size (plus alignment)
+const size_t MaxInputSize  = 64*1024;
+/// each sample runs the kernel often enough to take at least that long (clock resolution)
+const double MinSampleNs   = 20000;
+/// don't repeat more often than that per sample
+const size_t MaxBatchSize  = 1 << 20;
+/// percentile reported besides the median
+const double HighPercentile = 0.99;
+/// interference mode: hash table lookups between two CRC32 calls
+const size_t ProbesPerRound = 16;
+/// tuning: crc32_parallel processes this many bytes
+const size_t TuneParallelSize = 64*1024*1024;
+
+
+// timing with nanosecond resolution, never goes backwards
+static double nanoseconds()
+{
+#if defined(_WIN32) || defined(_WIN64)
+  LARGE_INTEGER frequency, now;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter  (&now);
+  return now.QuadPart * (1000000000.0 / frequency.QuadPart);
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000.0 + now.tv_nsec;
+#endif
+}
+
+// reference cycles (constant rate, independent of turbo boost), zero if not supported
+static uint64_t cycles()
+{
+#ifdef CRC32_BENCH_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// cheap timestamps for short code sections: reference cycles if available, else nanoseconds
+static uint64_t ticks()
+{
+#ifdef CRC32_BENCH_RDTSC
+  return __rdtsc();
+#else
+  return uint64_t(nanoseconds());
+#endif
+}
+
+// ticks per nanosecond
+static double ticksPerNanosecond()
+{
+  static double ratio = 0;
+  if (ratio == 0)
+  {
+    // busy wait for 20 ms
+    double   startNs    = nanoseconds();
+    uint64_t startTicks = ticks();
+    double   elapsedNs;
+    while ((elapsedNs = nanoseconds() - startNs) < 20000000)
+      ;
+    ratio = (ticks() - startTicks) / elapsedNs;
+  }
+  return ratio;
+}
+
+
+// crc32_16bytes_prefetch has an additional parameter
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+static uint32_t crc32_16bytes_prefetch256(const void* data, size_t length, uint32_t previousCrc32)
+{
+  return crc32_16bytes_prefetch(data, length, previousCrc32, 256);
+}
+#endif
+
+/// hardware performance counters of the current thread (user mode only), counted as a group
+class PerfCounters
+{
+public:
+  enum Counter { Cycles, Instructions, L1DMisses, LLCMisses, BranchMisses, NumCounters };
+
+  /// open all counters supported by the CPU / kernel
+  PerfCounters()
+  : m_leader(-1),
+    m_numOpen(0)
+  {
+    for (int i = 0; i < NumCounters; i++)
+      m_index[i] = -1;
+
+#ifdef CRC32_BENCH_PERF_EVENTS
+    static const uint32_t types  [NumCounters] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+    static const uint64_t configs[NumCounters] =
+    {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES, // last-level cache
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (int i = 0; i < NumCounters; i++)
+    {
+      perf_event_attr attributes;
+      memset(&attributes, 0, sizeof(attributes));
+      attributes.size           = sizeof(attributes);
+      attributes.type           = types  [i];
+      attributes.config         = configs[i];
+      attributes.disabled       = m_leader < 0 ? 1 : 0; // only the leader, it starts the whole group
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv     = 1;
+      attributes.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      int fd = int(syscall(__NR_perf_event_open, &attributes, 0, -1, m_leader, 0));
+      // not supported, e.g. in virtual machines => skip this counter
+      if (fd < 0)
+        continue;
+
+      if (m_leader < 0)
+        m_leader = fd;
+      m_fds  [m_numOpen] = fd;
+      m_index[i]         = m_numOpen++;
+    }
+
+    if (m_leader >= 0)
+      ioctl(m_leader, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  /// close all counters
+  ~PerfCounters()
+  {
+#ifdef CRC32_BENCH_PERF_EVENTS
+    for (int i = 0; i < m_numOpen; i++)
+      close(m_fds[i]);
+#endif
+  }
+
+  /// false if no counter is available
+  bool isOpen() const { return m_numOpen > 0; }
+  /// false if a counter isn't available
+  bool has(Counter counter) const { return m_index[counter] >= 0; }
+
+  /// current values of all counters (extrapolated if the kernel had to multiplex them)
+  void read(double values[NumCounters]) const
+  {
+    for (int i = 0; i < NumCounters; i++)
+      values[i] = 0;
+
+#ifdef CRC32_BENCH_PERF_EVENTS
+    // number of counters, time enabled, time running, one value per counter
+    uint64_t buffer[3 + NumCounters];
+    if (m_leader < 0 || ::read(m_leader, buffer, sizeof(buffer)) < ssize_t((3 + m_numOpen) * sizeof(uint64_t)))
+      return;
+
+    double scale = buffer[2] > 0 ? buffer[1] / double(buffer[2]) : 0;
+    for (int i = 0; i < NumCounters; i++)
+      if (m_index[i] >= 0)
+        values[i] = buffer[3 + m_index[i]] * scale;
+#endif
+  }
+
+  /// column names
+  static const char* name(int counter)
+  {
+    static const char* names[NumCounters] = { "core_cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+    return names[counter];
+  }
+
+private:
+  /// group leader (first open counter)
+  int m_leader;
+  /// file descriptors of all open counters
+  int m_fds[NumCounters];
+  int m_numOpen;
+  /// position of each counter in the group, -1 if not available
+  int m_index[NumCounters];
+
+  // no copies
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+};
+
+
+/// synthetic cache-sensitive workload: random lookups of existing keys in an open-addressing hash table
+class HashTableWorkload
+{
+public:
+  /// table with numBytes / 8 slots (rounded down to a power of two), half of them are used
+  explicit HashTableWorkload(size_t numBytes)
+  : m_slots(),
+    m_numKeys(0),
+    m_random(0x27121978)
+  {
+    size_t numSlots = 16;
+    while (2 * numSlots * sizeof(uint64_t) <= numBytes)
+      numSlots *= 2;
+    m_slots.resize(numSlots, 0);
+    m_numKeys = numSlots / 2;
+
+    // linear probing, zero means empty
+    for (size_t i = 0; i < m_numKeys; i++)
+    {
+      uint64_t key = hash(i);
+      size_t   pos = size_t(key) & (numSlots - 1);
+      while (m_slots[pos] != 0)
+        pos = (pos + 1) & (numSlots - 1);
+      m_slots[pos] = key;
+    }
+  }
+
+  /// look up numProbes random keys, return something depending on all slots visited
+  uint64_t run(size_t numProbes)
+  {
+    const size_t mask = m_slots.size() - 1;
+    uint64_t result = 0;
+    for (size_t i = 0; i < numProbes; i++)
+    {
+      // xorshift
+      m_random ^= m_random << 13;
+      m_random ^= m_random >>  7;
+      m_random ^= m_random << 17;
+
+      uint64_t key = hash(size_t(m_random) & (m_numKeys - 1));
+      size_t   pos = size_t(key) & mask;
+      while (m_slots[pos] != key)
+        pos = (pos + 1) & mask;
+      result += pos;
+    }
+    return result;
+  }
+
+  /// bytes occupied by the table
+  size_t getSize() const { return m_slots.size() * sizeof(uint64_t); }
+
+private:
+  /// scatter keys (never zero)
+  static uint64_t hash(uint64_t x)
+  {
+    x = (x + 1) * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 29;
+    return x | 1;
+  }
+
+  /// all slots
+  std::vector<uint64_t> m_slots;
+  /// keys 0 .. m_numKeys-1 are stored
+  size_t   m_numKeys;
+  /// state of random number generator
+  uint64_t m_random;
+};
+
+
+/// an algorithm
+struct Kernel
+{
+  const char*   name;
+  Crc32Function function;
+  /// false if the CPU lacks some instructions
+  bool          supported;
+};
+
+/// all algorithms available on this system
+static std::vector<Kernel> allKernels()
+{
+  std::vector<Kernel> kernels;
+  kernels.push_back({ "bitwise",            crc32_bitwise,            true });
+  kernels.push_back({ "halfbyte",           crc32_halfbyte,           true });
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+  kernels.push_back({ "1byte",              crc32_1byte,              true });
+#endif
+  kernels.push_back({ "tableless",          crc32_1byte_tableless,    true });
+  kernels.push_back({ "tableless2",         crc32_1byte_tableless2,   true });
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
+  kernels.push_back({ "4bytes",             crc32_4bytes,             true });
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
+  kernels.push_back({ "8bytes",             crc32_8bytes,             true });
+  kernels.push_back({ "4x8bytes",           crc32_4x8bytes,           true });
+  kernels.push_back({ "8bytes_interleaved", crc32_8bytes_interleaved, true });
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  kernels.push_back({ "16bytes",            crc32_16bytes,            true });
+  kernels.push_back({ "16bytes_prefetch",   crc32_16bytes_prefetch256, true });
+#endif
+#ifdef CRC32_USE_PCLMULQDQ
+  kernels.push_back({ "pclmul",             crc32_pclmul,             crc32_pclmul_supported() });
+#endif
+#ifdef CRC32_USE_VPCLMULQDQ
+  kernels.push_back({ "vpclmul",            crc32_vpclmul,            crc32_vpclmul_supported() });
+#endif
+  kernels.push_back({ "fast",               crc32_fast,               true });
+  // Castagnoli's polynomial
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  kernels.push_back({ "crc32c_16bytes",     crc32c_16bytes,           true });
+#endif
+#ifdef CRC32_USE_SSE42
+  kernels.push_back({ "crc32c_sse42",       crc32c_sse42,             crc32c_sse42_supported() });
+#endif
+  return kernels;
+}
+
+
+/// where the input comes from
+enum Input
+{
+  /// same buffer over and over again, stays in L1 cache
+  Warm,
+  /// walk through a huge buffer, each call sees data that was evicted long ago
+  Cold
+};
+
+/// statistics of a single configuration
+struct Result
+{
+  double medianNs;
+  double highNs;
+  /// per byte, zero if no cycle counter
+  double medianCycles;
+  double highCycles;
+  /// median of hardware performance counters per byte (only if requested)
+  double counters[PerfCounters::NumCounters];
+};
+
+
+/// nearest-rank percentile, values will be sorted
+static double percentile(std::vector<double>& values, double p)
+{
+  std::sort(values.begin(), values.end());
+  size_t rank = size_t(std::ceil(p * values.size()));
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+
+/// run a kernel numSamples times (plus warm-up), each sample is the average of a batch of calls
+static Result measure(Crc32Function function, const uint8_t* buffer, size_t bufferSize, Input input,
+                      size_t size, size_t alignment, size_t numSamples, const PerfCounters* counters = NULL)
+{
+  // warm: always the same bytes, cold: advance to the next cache line after each call, wrap around at the end of the buffer
+  size_t stride   = input == Cold ? (size + alignment + 63) & ~size_t(63) : 0;
+  size_t position = 0;
+  volatile uint32_t sink = 0;
+
+  // run a batch of calls, return elapsed nanoseconds and cycles
+  auto batch = [&](size_t numCalls, double& elapsedNs, uint64_t& elapsedCycles)
+  {
+    uint32_t crc = 0;
+    double   startNs     = nanoseconds();
+    uint64_t startCycles = cycles();
+    for (size_t i = 0; i < numCalls; i++)
+    {
+      // independent messages => measures throughput, not latency of chained calls
+      crc ^= function(buffer + position + alignment, size, 0);
+      position += stride;
+      if (position + stride > bufferSize)
+        position = 0;
+    }
+    elapsedCycles = cycles() - startCycles;
+    elapsedNs     = nanoseconds() - startNs;
+    sink = sink ^ crc;
+  };
+
+  // warm-up: the very first call may be much slower (page faults, lazy CPU detection / profile loading)
+  // and must not influence the batch size
+  size_t   batchSize = 1;
+  double   elapsedNs;
+  uint64_t elapsedCycles;
+  batch(batchSize, elapsedNs, elapsedCycles);
+
+  // find a batch size that takes long enough to be measured precisely
+  while (true)
+  {
+    batch(batchSize, elapsedNs, elapsedCycles);
+    if (elapsedNs >= MinSampleNs || batchSize >= MaxBatchSize)
+      break;
+    batchSize *= 2;
+  }
+  // once more with the final batch size
+  batch(batchSize, elapsedNs, elapsedCycles);
+
+  std::vector<double> ns, cyclesPerByte;
+  std::vector<double> events[PerfCounters::NumCounters];
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    double before[PerfCounters::NumCounters] = { 0 }, after[PerfCounters::NumCounters] = { 0 };
+    if (counters)
+      counters->read(before);
+
+    batch(batchSize, elapsedNs, elapsedCycles);
+
+    if (counters)
+    {
+      counters->read(after);
+      for (int j = 0; j < PerfCounters::NumCounters; j++)
+        events[j].push_back((after[j] - before[j]) / double(batchSize * size));
+    }
+
+    ns           .push_back(elapsedNs / batchSize);
+    cyclesPerByte.push_back(elapsedCycles / double(batchSize * size));
+  }
+
+  Result result;
+  for (int j = 0; j < PerfCounters::NumCounters; j++)
+    result.counters[j] = counters ? percentile(events[j], 0.5) : 0;
+  result.medianCycles = percentile(cyclesPerByte, 0.5);
+  result.highCycles   = percentile(cyclesPerByte, HighPercentile);
+  result.medianNs     = percentile(ns, 0.5);
+  result.highNs       = percentile(ns, HighPercentile);
+  return result;
+}
+
+
+/// interference mode: time per CRC32 call and per round of hash table lookups, alone and interleaved
+struct InterferenceResult
+{
+  double crcAloneNs;
+  double crcMixedNs;
+  double workloadAloneNs;
+  double workloadMixedNs;
+};
+
+
+/// each round runs ProbesPerRound hash table lookups and a CRC32 call, both are timed separately
+static InterferenceResult measureInterference(Crc32Function function, const uint8_t* buffer, size_t bufferSize, Input input,
+                                              size_t size, size_t alignment, size_t numSamples, HashTableWorkload& workload)
+{
+  // same as measure()
+  size_t stride   = input == Cold ? (size + alignment + 63) & ~size_t(63) : 0;
+  size_t position = 0;
+  volatile uint64_t sink = 0;
+
+  // average nanoseconds of each part of a round, parts can be skipped
+  auto rounds = [&](size_t numRounds, bool runWorkload, bool runCrc, double& workloadNs, double& crcNs)
+  {
+    uint64_t workloadTicks = 0, crcTicks = 0;
+    uint64_t check = 0;
+    for (size_t i = 0; i < numRounds; i++)
+    {
+      uint64_t start = ticks();
+      if (runWorkload)
+        check += workload.run(ProbesPerRound);
+      uint64_t middle = ticks();
+      if (runCrc)
+      {
+        check += function(buffer + position + alignment, size, 0);
+        position += stride;
+        if (position + stride > bufferSize)
+          position = 0;
+      }
+      uint64_t end = ticks();
+
+      workloadTicks += middle - start;
+      crcTicks      += end    - middle;
+    }
+    sink = sink + check;
+
+    double scale = 1 / (ticksPerNanosecond() * numRounds);
+    workloadNs = workloadTicks * scale;
+    crcNs      = crcTicks      * scale;
+  };
+
+  // warm-up: ignore the first, possibly much slower round
+  size_t numRounds = 1;
+  double workloadNs, crcNs;
+  rounds(numRounds, true, true, workloadNs, crcNs);
+
+  // find a number of rounds that takes long enough to be measured precisely
+  while (true)
+  {
+    rounds(numRounds, true, true, workloadNs, crcNs);
+    if (numRounds * (workloadNs + crcNs) >= MinSampleNs || numRounds >= MaxBatchSize)
+      break;
+    numRounds *= 2;
+  }
+
+  // alternate between all variants so that frequency changes etc. affect all of them
+  std::vector<double> crcAlone, crcMixed, workloadAlone, workloadMixed;
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    // timestamps aren't free: subtract the time of empty sections
+    double overheadWorkload, overheadCrc, unused;
+    rounds(numRounds, false, false, overheadWorkload, overheadCrc);
+
+    rounds(numRounds, false, true,  unused, crcNs);
+    crcAlone     .push_back(crcNs      - overheadCrc);
+    rounds(numRounds, true,  false, workloadNs, unused);
+    workloadAlone.push_back(workloadNs - overheadWorkload);
+    rounds(numRounds, true,  true,  workloadNs, crcNs);
+    crcMixed     .push_back(crcNs      - overheadCrc);
+    workloadMixed.push_back(workloadNs - overheadWorkload);
+  }
+
+  InterferenceResult result;
+  result.crcAloneNs      = percentile(crcAlone,      0.5);
+  result.crcMixedNs      = percentile(crcMixed,      0.5);
+  result.workloadAloneNs = percentile(workloadAlone, 0.5);
+  result.workloadMixedNs = percentile(workloadMixed, 0.5);
+  return result;
+}
+
+
+#ifdef CRC32_USE_PROFILE
+/// median nanoseconds of crc32_parallel
+static double measureParallel(const uint8_t* data, size_t length, Crc32ThreadPool& pool, size_t numSamples)
+{
+  volatile uint32_t sink = 0;
+  std::vector<double> ns;
+  // first call is a warm-up
+  for (size_t i = 0; i <= numSamples; i++)
+  {
+    double start = nanoseconds();
+    sink = sink ^ crc32_parallel(data, length, 0, &pool);
+    if (i > 0)
+      ns.push_back(nanoseconds() - start);
+  }
+  return percentile(ns, 0.5);
+}
+
+
+/// measure algorithms, prefetch distances and parallel block sizes, write the best ones to a profile
+static bool tune(const char* filename, const uint8_t* buffer, size_t bufferSize, size_t numSamples)
+{
+  // start with built-in settings
+  Crc32Profile profile = { { NULL, NULL, NULL, NULL }, 0, 0, 0 };
+  crc32_set_profile(profile);
+
+  // look-ahead of crc32_16bytes_prefetch, data streamed from DRAM
+  const size_t LargeSize = 1024*1024;
+  Crc32Function prefetch = crc32_algorithm("16bytes_prefetch");
+  if (prefetch != NULL)
+  {
+    double bestNs       = 0;
+    size_t bestDistance = 0;
+    for (size_t distance = 64; distance <= 4096; distance *= 2)
+    {
+      profile.prefetchAhead = distance;
+      crc32_set_profile(profile);
+      double ns = measure(prefetch, buffer, bufferSize, Cold, LargeSize, 0, numSamples).medianNs;
+      fprintf(stderr, "prefetch %4d bytes ahead: %.3f GB/s\n", int(distance), LargeSize / ns);
+      if (bestNs == 0 || ns < bestNs)
+      {
+        bestNs       = ns;
+        bestDistance = distance;
+      }
+    }
+    profile.prefetchAhead = bestDistance;
+    crc32_set_profile(profile);
+  }
+
+  // algorithm of each size class: two typical sizes per class, small inputs are usually cached
+  const size_t sizes[Crc32Profile::NumSizeClasses][2] = { { 64, 192 }, { 1024, 3072 }, { 16*1024, 48*1024 }, { 256*1024, LargeSize } };
+  for (size_t sizeClass = 0; sizeClass < Crc32Profile::NumSizeClasses; sizeClass++)
+  {
+    Input  input   = sizeClass + 1 < Crc32Profile::NumSizeClasses ? Warm : Cold;
+    double bestNsPerByte = 0;
+    for (auto& kernel : allKernels())
+    {
+      // only algorithms known to crc32_fast
+      Crc32Function function = crc32_algorithm(kernel.name);
+      if (function == NULL)
+        continue;
+
+      double nsPerByte = 0;
+      for (auto size : sizes[sizeClass])
+        nsPerByte += measure(function, buffer, bufferSize, input, size, 0, numSamples).medianNs / size;
+      if (bestNsPerByte == 0 || nsPerByte < bestNsPerByte)
+      {
+        bestNsPerByte = nsPerByte;
+        profile.algorithms[sizeClass] = kernel.name;
+      }
+    }
+    fprintf(stderr, "%d to %d bytes: %s, %.3f GB/s\n", int(sizes[sizeClass][0]), int(sizes[sizeClass][1]),
+            profile.algorithms[sizeClass], 2 / bestNsPerByte);
+  }
+  crc32_set_profile(profile);
+
+  Crc32ThreadPool pool;
+  size_t numThreads = pool.getNumThreads();
+  if (numThreads > 1 && bufferSize >= TuneParallelSize)
+  {
+    // bytes per task (0 => one block per thread)
+    double bestNs        = 0;
+    size_t bestBlockSize = 0;
+    for (size_t blockSize = 0; blockSize <= 16*1024*1024; blockSize = blockSize == 0 ? 256*1024 : 4 * blockSize)
+    {
+      profile.parallelBlockSize = blockSize;
+      crc32_set_profile(profile);
+      double ns = measureParallel(buffer, TuneParallelSize, pool, numSamples);
+      fprintf(stderr, "parallel, %d bytes per task: %.3f GB/s\n", int(blockSize), TuneParallelSize / ns);
+      if (bestNs == 0 || ns < bestNs)
+      {
+        bestNs        = ns;
+        bestBlockSize = blockSize;
+      }
+    }
+    profile.parallelBlockSize = bestBlockSize;
+    crc32_set_profile(profile);
+
+    // smallest block size where all threads are faster than a single one
+    for (size_t minBlockSize = 16*1024; minBlockSize <= 4*1024*1024; minBlockSize *= 2)
+    {
+      size_t length = minBlockSize * numThreads;
+      pool.setMinBlockSize(length);
+      double single   = measureParallel(buffer, length, pool, numSamples);
+      pool.setMinBlockSize(minBlockSize);
+      double parallel = measureParallel(buffer, length, pool, numSamples);
+      if (parallel < single)
+      {
+        fprintf(stderr, "parallel is faster than single-threaded for %d bytes per thread\n", int(minBlockSize));
+        profile.parallelMinBlockSize = minBlockSize;
+        break;
+      }
+    }
+  }
+  else
+    fprintf(stderr, "only one thread: crc32_parallel keeps its defaults\n");
+
+  crc32_set_profile(profile);
+  return crc32_save_profile(filename, profile);
+}
+#endif
+
+
+/// parse a comma-separated list of numbers, false if invalid
+static bool parseList(const char* text, std::vector<size_t>& values)
+{
+  values.clear();
+  while (*text)
+  {
+    char* end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || (*end != ',' && *end != 0))
+      return false;
+    values.push_back(size_t(value));
+    text = (*end == ',') ? end + 1 : end;
+  }
+  return !values.empty();
+}
+
+
+int main(int argc, char* argv[])
+{
+  // parse options
+  bool json = false;
+  std::vector<size_t> sizes;
+  for (size_t size = 64; size <= MaxInputSize; size *= 2)
+    sizes.push_back(size);
+  std::vector<size_t> alignments = { 0, 1, 4, 8 };
+  bool   useWarm    = true;
+  bool   useCold    = true;
+  size_t numSamples = 200;
+  std::string kernelNames; // empty => all
+  bool   useCounters = false;
+  size_t tableSize   = 0; // interference mode if > 0
+  const char* profileName = NULL; // tuning mode if set
+#ifdef CRC32_USE_PROFILE
+  bool   hasSamples  = false;
+#endif
+  bool ok = true;
+  for (int i = 1; i < argc && ok; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "-f") == 0 && hasValue)
+    {
+      i++;
+      json = strcmp(argv[i], "json") == 0;
+      ok   = json || strcmp(argv[i], "csv") == 0;
+    }
+    else if (strcmp(argv[i], "-s") == 0 && hasValue)
+      ok = parseList(argv[++i], sizes);
+    else if (strcmp(argv[i], "-a") == 0 && hasValue)
+      ok = parseList(argv[++i], alignments);
+    else if (strcmp(argv[i], "-i") == 0 && hasValue)
+    {
+      i++;
+      useWarm = strcmp(argv[i], "warm") == 0 || strcmp(argv[i], "both") == 0;
+      useCold = strcmp(argv[i], "cold") == 0 || strcmp(argv[i], "both") == 0;
+      ok = useWarm || useCold;
+    }
+    else if (strcmp(argv[i], "-n") == 0 && hasValue)
+    {
+      numSamples = size_t(atoi(argv[++i]));
+      ok = numSamples > 0;
+#ifdef CRC32_USE_PROFILE
+      hasSamples = true;
+#endif
+    }
+    else if (strcmp(argv[i], "-k") == 0 && hasValue)
+      kernelNames = std::string(",") + argv[++i] + ",";
+    else if (strcmp(argv[i], "-c") == 0)
+      useCounters = true;
+    else if (strcmp(argv[i], "-w") == 0 && hasValue)
+    {
+      tableSize = size_t(atoi(argv[++i])) * 1024;
+      ok = tableSize > 0;
+    }
+#ifdef CRC32_USE_PROFILE
+    else if (strcmp(argv[i], "-t") == 0 && hasValue)
+      profileName = argv[++i];
+#endif
+    else
+      ok = false;
+
+    if (!ok)
+    {
+      bool help = strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0;
+      fprintf(help ? stdout : stderr,
+             "usage: Crc32Bench [-f csv|json] [-s sizes] [-a alignments] [-i warm|cold|both] [-n samples] [-k kernels] [-c | -w kilobytes]\n"
+             "       Crc32Bench -t profile [-n samples]\n"
+             "measures each CRC32 algorithm, prints median and 99th percentile per call\n"
+             "  -f  output format (default: csv)\n"
+             "  -s  comma-separated input sizes in bytes, at most %d (default: 64,128,...,65536)\n"
+             "  -a  comma-separated offsets from a 64 byte boundary (default: 0,1,4,8)\n"
+             "  -i  input in L1 cache (warm), streamed from DRAM (cold) or both (default)\n"
+             "  -n  number of samples per configuration (default: 200)\n"
+             "  -k  comma-separated algorithms, e.g. 16bytes,pclmul (default: all)\n"
+             "  -c  add hardware performance counters per byte (Linux only)\n"
+             "  -w  interleave each call with %d lookups in a hash table of that size (e.g. 32),\n"
+             "      compare CRC32 throughput and lookup time with and without each other\n"
+             "  -t  find the best algorithm per input size, prefetch distance and parallel block sizes,\n"
+             "      write them to a profile for crc32_fast and crc32_parallel (default: 25 samples)\n",
+             int(MaxInputSize), int(ProbesPerRound));
+      return help ? 0 : 1;
+    }
+  }
+  for (auto size : sizes)
+    if (size == 0 || size > MaxInputSize)
+    {
+      fprintf(stderr, "input size must be between 1 and %d bytes\n", int(MaxInputSize));
+      return 1;
+    }
+  for (auto alignment : alignments)
+    if (alignment >= 64)
+    {
+      fprintf(stderr, "alignment must be less than 64\n");
+      return 1;
+    }
+  if (useCounters && tableSize > 0)
+  {
+    fprintf(stderr, "options -c and -w can't be combined\n");
+    return 1;
+  }
+
+  // don't touch perf_event_open at all unless requested
+  std::unique_ptr<PerfCounters> counters;
+  if (useCounters)
+  {
+    counters.reset(new PerfCounters);
+    if (!counters->isOpen())
+    {
+      fprintf(stderr, "hardware performance counters are not available (no PMU, e.g. in a virtual machine, or see /proc/sys/kernel/perf_event_paranoid)\n");
+      return 1;
+    }
+    for (int j = 0; j < PerfCounters::NumCounters; j++)
+      if (!counters->has(PerfCounters::Counter(j)))
+        fprintf(stderr, "counter %s is not available\n", PerfCounters::name(j));
+  }
+
+  // random data, all pages are touched before measuring
+  size_t warmSize = MaxInputSize + 64;
+  size_t coldSize = (useCold || profileName != NULL) ? StreamingBufferSize : 0;
+  std::vector<uint8_t> storage(warmSize + coldSize + 64);
+  uint32_t randomNumber = 0x27121978;
+  for (auto& x : storage)
+  {
+    x = uint8_t(randomNumber >> 24);
+    randomNumber = 1664525 * randomNumber + 1013904223;
+  }
+  // 64 byte alignment
+  uint8_t* warm = storage.data() + ((64 - size_t(storage.data()) % 64) % 64);
+  uint8_t* cold = warm + warmSize;
+
+#ifdef CRC32_USE_PROFILE
+  if (profileName != NULL)
+  {
+    if (!tune(profileName, cold, coldSize, hasSamples ? numSamples : 25))
+    {
+      fprintf(stderr, "failed to write %s\n", profileName);
+      return 1;
+    }
+    fprintf(stderr, "profile written to %s, use it with CRC32_PROFILE=%s\n", profileName, profileName);
+    return 0;
+  }
+#endif
+
+  HashTableWorkload workload(tableSize);
+
+  // header
+  if (json)
+    printf("[\n");
+  else if (tableSize > 0)
+    printf("kernel,bytes,alignment,input,table_kb,crc_alone_gb_per_s,crc_mixed_gb_per_s,crc_slowdown,"
+           "workload_alone_ns,workload_mixed_ns,workload_slowdown\n");
+  else
+  {
+    printf("kernel,bytes,alignment,input,median_ns,p99_ns,median_cycles_per_byte,p99_cycles_per_byte,median_gb_per_s");
+    if (useCounters)
+      for (int j = 0; j < PerfCounters::NumCounters; j++)
+        printf(",%s_per_byte", PerfCounters::name(j));
+    printf("\n");
+  }
+
+  bool first = true;
+  for (auto& kernel : allKernels())
+  {
+    if (!kernelNames.empty() && kernelNames.find(std::string(",") + kernel.name + ",") == std::string::npos)
+      continue;
+    if (!kernel.supported)
+    {
+      fprintf(stderr, "skipping %s (not supported by this CPU)\n", kernel.name);
+      continue;
+    }
+    fprintf(stderr, "%s ...\n", kernel.name);
+
+    for (int input = Warm; input <= Cold; input++)
+    {
+      if ((input == Warm && !useWarm) || (input == Cold && !useCold))
+        continue;
+
+      for (auto size : sizes)
+        for (auto alignment : alignments)
+        {
+          const char* inputName = input == Warm ? "warm" : "cold";
+
+          if (tableSize > 0)
+          {
+            InterferenceResult result = input == Warm ?
+                measureInterference(kernel.function, warm, warmSize, Warm, size, alignment, numSamples, workload) :
+                measureInterference(kernel.function, cold, coldSize, Cold, size, alignment, numSamples, workload);
+
+            double crcSlowdown      = result.crcMixedNs      / result.crcAloneNs;
+            double workloadSlowdown = result.workloadMixedNs / result.workloadAloneNs;
+            if (json)
+              printf("%s  { \"kernel\": \"%s\", \"bytes\": %d, \"alignment\": %d, \"input\": \"%s\", \"table_kb\": %d, "
+                     "\"crc_alone_gb_per_s\": %.3f, \"crc_mixed_gb_per_s\": %.3f, \"crc_slowdown\": %.3f, "
+                     "\"workload_alone_ns\": %.2f, \"workload_mixed_ns\": %.2f, \"workload_slowdown\": %.3f }",
+                     first ? "" : ",\n", kernel.name, int(size), int(alignment), inputName, int(workload.getSize() / 1024),
+                     size / result.crcAloneNs, size / result.crcMixedNs, crcSlowdown,
+                     result.workloadAloneNs, result.workloadMixedNs, workloadSlowdown);
+            else
+              printf("%s,%d,%d,%s,%d,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f\n",
+                     kernel.name, int(size), int(alignment), inputName, int(workload.getSize() / 1024),
+                     size / result.crcAloneNs, size / result.crcMixedNs, crcSlowdown,
+                     result.workloadAloneNs, result.workloadMixedNs, workloadSlowdown);
+            fflush(stdout);
+            first = false;
+            continue;
+          }
+
+          Result result = input == Warm ?
+              measure(kernel.function, warm, warmSize, Warm, size, alignment, numSamples, counters.get()) :
+              measure(kernel.function, cold, coldSize, Cold, size, alignment, numSamples, counters.get());
+
+          double gigabytesPerSecond = size / result.medianNs;
+#ifdef CRC32_BENCH_RDTSC
+          char medianCycles[32], highCycles[32];
+          snprintf(medianCycles, sizeof(medianCycles), "%.3f", result.medianCycles);
+          snprintf(highCycles,   sizeof(highCycles),   "%.3f", result.highCycles);
+#else
+          // no cycle counter
+          const char* medianCycles = json ? "null" : "";
+          const char* highCycles   = json ? "null" : "";
+#endif
+
+          if (json)
+            printf("%s  { \"kernel\": \"%s\", \"bytes\": %d, \"alignment\": %d, \"input\": \"%s\", "
+                   "\"median_ns\": %.2f, \"p99_ns\": %.2f, \"median_cycles_per_byte\": %s, \"p99_cycles_per_byte\": %s, "
+                   "\"median_gb_per_s\": %.3f",
+                   first ? "" : ",\n", kernel.name, int(size), int(alignment), inputName,
+                   result.medianNs, result.highNs, medianCycles, highCycles, gigabytesPerSecond);
+          else
+            printf("%s,%d,%d,%s,%.2f,%.2f,%s,%s,%.3f",
+                   kernel.name, int(size), int(alignment), inputName,
+                   result.medianNs, result.highNs, medianCycles, highCycles, gigabytesPerSecond);
+
+          // per byte, misses are rare => more digits
+          if (useCounters)
+            for (int j = 0; j < PerfCounters::NumCounters; j++)
+            {
+              bool available = counters->has(PerfCounters::Counter(j));
+              if (json && available)
+                printf(", \"%s_per_byte\": %.6f", PerfCounters::name(j), result.counters[j]);
+              else if (json)
+                printf(", \"%s_per_byte\": null",  PerfCounters::name(j));
+              else if (available)
+                printf(",%.6f", result.counters[j]);
+              else
+                printf(",");
+            }
+          printf(json ? " }" : "\n");
+          fflush(stdout);
+          first = false;
+        }
+    }
+  }
+
+  if (json)
+    printf("\n]\n");
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+// //////////////////////////////////////////////////////////
+// Crc32Chunker.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+#include "Crc32Chunker.h"
+
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+/// chunks are between minSize and maxSize bytes long
+Crc32Chunker::Crc32Chunker(size_t minSize, size_t avgSize, size_t maxSize, size_t windowSize)
+: m_minSize(minSize),
+  m_maxSize(maxSize),
+  m_mask(0),
+  m_rolling(windowSize > 0 ? windowSize : 1)
+{
+  // the first window must fit into the shortest chunk
+  if (m_minSize < m_rolling.getWindowSize())
+    m_minSize = m_rolling.getWindowSize();
+  if (m_maxSize < m_minSize)
+    m_maxSize = m_minSize;
+
+  // a boundary is found after about mask + 1 bytes (plus the minimum size which is never searched)
+  // => pick the power of two closest to avgSize - minSize
+  size_t search = (avgSize > m_minSize) ? avgSize - m_minSize : 1;
+  size_t power  = 1;
+  while (2 * power <= search && power < (size_t(1) << 31))
+    power *= 2;
+  if (search - power > 2 * power - search && power < (size_t(1) << 31))
+    power *= 2;
+  m_mask = uint32_t(power - 1);
+}
+
+
+/// length of the chunk starting at data
+size_t Crc32Chunker::next(const void* data, size_t length, uint32_t& crc32)
+{
+  const uint8_t* current = (const uint8_t*) data;
+
+  size_t limit = (length < m_maxSize) ? length : m_maxSize;
+  size_t end   = limit;
+
+  // no boundary within the first minSize bytes => skip them, only the window right before a boundary matters
+  if (limit > m_minSize)
+  {
+    const size_t windowSize = m_rolling.getWindowSize();
+    end = m_minSize;
+    uint32_t window = m_rolling.reset(current + end - windowSize);
+    while ((window & m_mask) != 0 && end < limit)
+    {
+      window = m_rolling.roll(current[end - windowSize], current[end]);
+      end++;
+    }
+  }
+
+  // the chunk is still in the CPU cache: a second pass with crc32_fast is much cheaper than a bytewise CRC
+  crc32 = crc32_fast(current, end);
+  return end;
+}
+
+
+/// split data into chunks
+std::vector<Crc32Chunker::Chunk> Crc32Chunker::split(const void* data, size_t length)
+{
+  const uint8_t* current = (const uint8_t*) data;
+
+  std::vector<Chunk> result;
+  size_t offset = 0;
+  while (offset < length)
+  {
+    Chunk chunk;
+    chunk.offset = offset;
+    chunk.length = next(current + offset, length - offset, chunk.crc32);
+    result.push_back(chunk);
+
+    offset += chunk.length;
+  }
+
+  return result;
+}
+#endif
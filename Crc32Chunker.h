@@ -0,0 +1,58 @@
+// //////////////////////////////////////////////////////////
+// Crc32Chunker.h
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// content-defined chunking, e.g. for deduplication: boundaries depend only on nearby bytes
+// and therefore survive insertions and deletions elsewhere in the data
+
+#pragma once
+
+#include "Crc32.h"
+
+#include <vector>
+
+
+// Crc32Rolling needs Crc32Lookup[0]
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+/// cut a chunk where the rolling CRC32 of the last few bytes matches a bit mask, return each chunk's CRC32, too
+class Crc32Chunker
+{
+public:
+  /// a part of the data
+  struct Chunk
+  {
+    /// position of the first byte
+    size_t   offset;
+    /// number of bytes
+    size_t   length;
+    /// CRC32 of all bytes of the chunk
+    uint32_t crc32;
+  };
+
+  /// chunks are between minSize and maxSize bytes long, their average size is about avgSize bytes,
+  /// boundaries are decided by a rolling CRC32 of windowSize bytes
+  Crc32Chunker(size_t minSize = 2*1024, size_t avgSize = 8*1024, size_t maxSize = 64*1024, size_t windowSize = 48);
+
+  /// length of the chunk starting at data, crc32 receives its CRC32
+  /// (pass at least maxSize bytes unless data is the end of a stream)
+  size_t next(const void* data, size_t length, uint32_t& crc32);
+  /// split data into chunks
+  std::vector<Chunk> split(const void* data, size_t length);
+
+  size_t getMinSize()    const { return m_minSize; }
+  size_t getMaxSize()    const { return m_maxSize; }
+  size_t getWindowSize() const { return m_rolling.getWindowSize(); }
+
+private:
+  /// no chunk is shorter, except the last one
+  size_t   m_minSize;
+  /// no chunk is longer
+  size_t   m_maxSize;
+  /// cut if (rolling CRC32 & m_mask) == 0
+  uint32_t m_mask;
+  /// CRC32 of a sliding window
+  Crc32Rolling m_rolling;
+};
+#endif
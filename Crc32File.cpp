@@ -0,0 +1,531 @@
+// //////////////////////////////////////////////////////////
+// Crc32File.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// 64 bit file offsets on 32 bit systems (must be identical in all translation units, the Makefile defines it, too)
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "Crc32File.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// io_uring is accessed by raw system calls (no liburing needed), falls back to pread() if the kernel refuses
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CRC32_USE_IO_URING
+#endif
+#endif
+
+#ifdef CRC32_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace
+{
+  /// O_DIRECT requires buffers, offsets and lengths aligned to the device's logical block size, 4 KB is safe
+  const size_t DirectAlignment = 4096;
+
+  /// a part of the file which is read at once
+  struct Block
+  {
+    /// aligned buffer
+    uint8_t* data;
+    /// bytes requested, a multiple of DirectAlignment
+    size_t   length;
+    /// position in file
+    uint64_t offset;
+    /// bytes until end of file (if known), else length
+    size_t   expected;
+    /// bytes received so far
+    size_t   filled;
+    /// 0 or errno
+    int      error;
+    /// true if read completely
+    bool     done;
+    /// buffer description for readv-like calls
+    struct iovec io;
+  };
+
+
+  /// buffers and file position, shared by both implementations
+  class Pipeline
+  {
+  public:
+    Pipeline(int fd, size_t blockSize, size_t queueDepth)
+    : m_fd(fd),
+      m_blocks(queueDepth > 0 ? queueDepth : 1),
+      m_memory(NULL),
+      m_fileSize(UnknownSize),
+      m_nextOffset(0)
+    {
+      // file size is known only for regular files, block devices report zero
+      struct stat info;
+      if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+        m_fileSize = uint64_t(info.st_size);
+
+      blockSize = (blockSize + DirectAlignment - 1) & ~(DirectAlignment - 1);
+      if (blockSize == 0)
+        blockSize = DirectAlignment;
+
+      void* memory;
+      if (posix_memalign(&memory, DirectAlignment, blockSize * m_blocks.size()) != 0)
+        return;
+      m_memory = (uint8_t*)memory;
+
+      for (size_t i = 0; i < m_blocks.size(); i++)
+      {
+        m_blocks[i].data   = m_memory + i * blockSize;
+        m_blocks[i].length = blockSize;
+      }
+    }
+
+    ~Pipeline()
+    {
+      free(m_memory);
+    }
+
+    /// false if memory allocation failed
+    bool isValid() const { return m_memory != NULL; }
+
+    /// leak the buffers instead of freeing them (pending asynchronous reads can't be cancelled)
+    void abandon() { m_memory = NULL; }
+
+    int getFileHandle() const { return m_fd; }
+    std::vector<Block>& getBlocks() { return m_blocks; }
+
+    /// assign the next part of the file to a block, false if end of file is reached (block is then empty)
+    bool prepare(Block& block)
+    {
+      block.offset   = m_nextOffset;
+      block.expected = block.length;
+      block.filled   = 0;
+      block.error    = 0;
+      block.done     = false;
+
+      if (m_fileSize != UnknownSize)
+      {
+        if (m_nextOffset >= m_fileSize)
+          return false;
+        if (block.expected > m_fileSize - m_nextOffset)
+          block.expected = size_t(m_fileSize - m_nextOffset);
+      }
+
+      m_nextOffset += block.length;
+      return true;
+    }
+
+    /// process the result of a read (negative => -errno), returns true if block is finished
+    static bool received(Block& block, long result)
+    {
+      // try again
+      if (result == -EINTR || result == -EAGAIN)
+        return false;
+
+      if (result < 0)
+      {
+        block.error = int(-result);
+        return true;
+      }
+
+      // a short read requires another request for the remainder, zero bytes mean end of file
+      block.filled += size_t(result);
+      return result == 0 || block.filled >= block.expected;
+    }
+
+    /// true if no further blocks have to be processed
+    static bool isLast(const Block& block)
+    {
+      return block.error != 0 || block.filled < block.length;
+    }
+
+  private:
+    /// no copies
+    Pipeline(const Pipeline&);
+    Pipeline& operator=(const Pipeline&);
+
+    static const uint64_t UnknownSize = ~uint64_t(0);
+
+    int                m_fd;
+    std::vector<Block> m_blocks;
+    uint8_t*           m_memory;
+    uint64_t           m_fileSize;
+    uint64_t           m_nextOffset;
+  };
+
+
+  /// hash a finished block, returns false if it was the last one
+  bool consume(const Block& block, Crc32Function algorithm, uint32_t& crc32, uint64_t& size, int& error)
+  {
+    if (block.error != 0)
+      error = block.error;
+    else
+    {
+      crc32 = algorithm(block.data, block.filled, crc32);
+      size += block.filled;
+    }
+
+    return !Pipeline::isLast(block);
+  }
+
+
+  /// reader thread fetches blocks with pread() while the calling thread hashes them
+  int hashThreaded(Pipeline& pipeline, Crc32Function algorithm, uint32_t& crc32, uint64_t& size)
+  {
+    std::vector<Block>& blocks = pipeline.getBlocks();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    // blocks read but not hashed yet
+    size_t numReady = 0;
+
+    std::thread reader([&]
+    {
+      for (size_t i = 0; ; i = (i + 1) % blocks.size())
+      {
+        // wait for a free buffer
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait(lock, [&] { return numReady < blocks.size(); });
+        }
+
+        Block& block = blocks[i];
+        if (pipeline.prepare(block))
+        {
+          ssize_t result;
+          do
+          {
+            result = pread(pipeline.getFileHandle(), block.data + block.filled,
+                           block.length - block.filled, off_t(block.offset + block.filled));
+          } while (!Pipeline::received(block, result < 0 ? -errno : long(result)));
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          numReady++;
+        }
+        changed.notify_all();
+
+        if (Pipeline::isLast(block))
+          return;
+      }
+    });
+
+    int  error = 0;
+    bool more  = true;
+    for (size_t i = 0; more; i = (i + 1) % blocks.size())
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return numReady > 0; });
+      }
+
+      more = consume(blocks[i], algorithm, crc32, size, error);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        numReady--;
+      }
+      changed.notify_all();
+    }
+
+    reader.join();
+    return error;
+  }
+
+
+#ifdef CRC32_USE_IO_URING
+  /// minimal io_uring wrapper
+  class IoUring
+  {
+  public:
+    explicit IoUring(unsigned entries)
+    : m_ring(-1),
+      m_sqRing(MAP_FAILED),
+      m_cqRing(MAP_FAILED),
+      m_sqes  (MAP_FAILED),
+      m_sqRingSize(0),
+      m_cqRingSize(0),
+      m_sqesSize  (0),
+      m_toSubmit(0),
+      m_pending (0)
+    {
+      io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      m_ring = int(syscall(__NR_io_uring_setup, entries, &params));
+      // not supported or forbidden (e.g. by a container's seccomp filter)
+      if (m_ring < 0)
+        return;
+
+      m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      m_cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+      m_sqesSize   = params.sq_entries * sizeof(io_uring_sqe);
+
+      // newer kernels map both rings at once
+      bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (singleMap && m_sqRingSize < m_cqRingSize)
+        m_sqRingSize = m_cqRingSize;
+
+      m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+      if (singleMap)
+        m_cqRingSize = 0;
+      else
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+      m_sqes   = mmap(NULL, m_sqesSize,   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+
+      if (m_sqRing == MAP_FAILED || (!singleMap && m_cqRing == MAP_FAILED) || m_sqes == MAP_FAILED)
+      {
+        close(m_ring);
+        m_ring = -1;
+        return;
+      }
+
+      char* sq = (char*)m_sqRing;
+      char* cq = (char*)(singleMap ? m_sqRing : m_cqRing);
+      m_sqTail  = (unsigned*)(sq + params.sq_off.tail);
+      m_sqMask  = *(unsigned*)(sq + params.sq_off.ring_mask);
+      m_sqArray = (unsigned*)(sq + params.sq_off.array);
+      m_cqHead  = (unsigned*)(cq + params.cq_off.head);
+      m_cqTail  = (unsigned*)(cq + params.cq_off.tail);
+      m_cqMask  = *(unsigned*)(cq + params.cq_off.ring_mask);
+      m_cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring()
+    {
+      if (m_sqes   != MAP_FAILED)
+        munmap(m_sqes,   m_sqesSize);
+      if (m_cqRing != MAP_FAILED)
+        munmap(m_cqRing, m_cqRingSize);
+      if (m_sqRing != MAP_FAILED)
+        munmap(m_sqRing, m_sqRingSize);
+      if (m_ring >= 0)
+        close(m_ring);
+    }
+
+    /// false if io_uring is not available
+    bool isValid() const { return m_ring >= 0; }
+
+    /// queue a request for the missing part of a block, it will be submitted by the next call of wait()
+    void read(int fd, Block& block, uint64_t id)
+    {
+      block.io.iov_base = block.data   + block.filled;
+      block.io.iov_len  = block.length - block.filled;
+
+      // only this thread modifies the tail
+      unsigned tail  = *m_sqTail;
+      unsigned index = tail & m_sqMask;
+
+      io_uring_sqe& sqe = ((io_uring_sqe*)m_sqes)[index];
+      memset(&sqe, 0, sizeof(sqe));
+      // IORING_OP_READ would require kernel 5.6 instead of 5.1
+      sqe.opcode    = IORING_OP_READV;
+      sqe.fd        = fd;
+      sqe.off       = block.offset + block.filled;
+      sqe.addr      = (uint64_t)(uintptr_t)&block.io;
+      sqe.len       = 1;
+      sqe.user_data = id;
+
+      m_sqArray[index] = index;
+      __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+      m_toSubmit++;
+    }
+
+    /// submit all queued requests and wait for the next completion, false on error
+    bool wait(uint64_t& id, long& result)
+    {
+      while (true)
+      {
+        if (m_toSubmit == 0 && pop(id, result))
+          return true;
+
+        bool empty = isEmpty();
+        // submit and block only if nothing is available yet
+        long submitted = syscall(__NR_io_uring_enter, m_ring, m_toSubmit, empty ? 1 : 0,
+                                 empty ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (submitted < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+        m_toSubmit -= unsigned(submitted);
+        m_pending  += unsigned(submitted);
+      }
+    }
+
+    /// wait until the kernel finished all submitted requests (queued ones are dropped), false on error
+    bool drain()
+    {
+      m_toSubmit = 0;
+      while (m_pending > 0)
+      {
+        uint64_t id;
+        long result;
+        if (pop(id, result))
+          continue;
+
+        if (syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+          return false;
+      }
+      return true;
+    }
+
+  private:
+    /// no copies
+    IoUring(const IoUring&);
+    IoUring& operator=(const IoUring&);
+
+    int    m_ring;
+    /// memory shared with the kernel
+    void*  m_sqRing;
+    void*  m_cqRing;
+    void*  m_sqes;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    size_t m_sqesSize;
+
+    /// submission queue
+    unsigned* m_sqTail;
+    unsigned  m_sqMask;
+    unsigned* m_sqArray;
+    /// completion queue
+    unsigned*     m_cqHead;
+    unsigned*     m_cqTail;
+    unsigned      m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    /// queued but not submitted yet
+    unsigned m_toSubmit;
+    /// submitted but not completed yet
+    unsigned m_pending;
+
+    /// true if no completion is available
+    bool isEmpty() const
+    {
+      return *m_cqHead == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    /// fetch the next completion, false if none available
+    bool pop(uint64_t& id, long& result)
+    {
+      if (isEmpty())
+        return false;
+
+      // only this thread modifies the head
+      unsigned head = *m_cqHead;
+      const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+      id     = cqe.user_data;
+      result = cqe.res;
+      __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+      m_pending--;
+      return true;
+    }
+  };
+
+
+  /// keep all blocks in flight and hash them in file order as soon as they are complete
+  int hashIoUring(Pipeline& pipeline, IoUring& ring, Crc32Function algorithm, uint32_t& crc32, uint64_t& size)
+  {
+    std::vector<Block>& blocks = pipeline.getBlocks();
+    int fd = pipeline.getFileHandle();
+
+    // initial requests
+    size_t inFlight = 0;
+    bool   reading  = true;
+    for (size_t i = 0; i < blocks.size() && reading; i++)
+    {
+      reading = pipeline.prepare(blocks[i]);
+      if (reading)
+      {
+        ring.read(fd, blocks[i], i);
+        inFlight++;
+      }
+    }
+
+    int  error   = 0;
+    bool hashing = true;
+    for (size_t i = 0; inFlight > 0; i = (i + 1) % blocks.size())
+    {
+      // blocks may complete out of order
+      Block& block = blocks[i];
+      while (!block.done)
+      {
+        uint64_t id;
+        long result;
+        if (!ring.wait(id, result))
+        {
+          error = errno;
+          // the kernel may still write into the buffers, keep them alive if it can't be stopped
+          if (!ring.drain())
+            pipeline.abandon();
+          return error;
+        }
+
+        Block& completed = blocks[id];
+        if (Pipeline::received(completed, result))
+          completed.done = true;
+        else
+          ring.read(fd, completed, id);
+      }
+      inFlight--;
+
+      // after the end of file or an error only outstanding requests are collected
+      if (!hashing)
+        continue;
+      hashing = consume(block, algorithm, crc32, size, error);
+
+      // reuse buffer for the next part of the file
+      if (hashing && reading)
+        reading = pipeline.prepare(block);
+      if (hashing && reading)
+      {
+        ring.read(fd, block, i);
+        inFlight++;
+      }
+    }
+
+    return error;
+  }
+#endif
+} // anonymous namespace
+
+
+/// compute CRC32 of a file, reading and hashing in parallel
+bool crc32_file(int fd, uint32_t& crc32, uint64_t& size, size_t blockSize, size_t queueDepth, Crc32Function algorithm)
+{
+  Pipeline pipeline(fd, blockSize, queueDepth);
+  if (!pipeline.isValid())
+  {
+    errno = ENOMEM;
+    return false;
+  }
+
+  int error;
+#ifdef CRC32_USE_IO_URING
+  IoUring ring(unsigned(pipeline.getBlocks().size()));
+  if (ring.isValid())
+    error = hashIoUring(pipeline, ring, algorithm, crc32, size);
+  else
+#endif
+    error = hashThreaded(pipeline, algorithm, crc32, size);
+
+  if (error != 0)
+  {
+    errno = error;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,20 @@
+// //////////////////////////////////////////////////////////
+// Crc32File.h
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// pipelined file hashing: several blocks are read asynchronously (io_uring on Linux, else a reader thread with pread)
+// while completed blocks are hashed, total time approaches max(I/O, CPU) instead of their sum
+// POSIX only, link with -pthread
+
+#pragma once
+
+#include "Crc32Parallel.h"
+
+
+/// compute CRC32 of a file from its beginning to its end, returns false and sets errno on failure
+/// crc32 holds the previous CRC32 (usually 0) and receives the result, size receives the number of bytes processed
+/// fd may be opened with O_DIRECT: buffers are aligned to 4 KB and blockSize is rounded up to a multiple of 4 KB
+bool crc32_file(int fd, uint32_t& crc32, uint64_t& size,
+                size_t blockSize = 1024*1024, size_t queueDepth = 8, Crc32Function algorithm = crc32_fast);
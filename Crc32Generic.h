@@ -0,0 +1,235 @@
+// //////////////////////////////////////////////////////////
+// Crc32Generic.h
+// Copyright (c) 2011-2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// generic CRC-32 engine: all lookup tables are generated at compile time (requires C++14)
+//
+// usage:
+//   uint32_t crc = Crc32Bzip2::compute(data, length);
+//   // continue with more data
+//   crc = Crc32Bzip2::compute(moreData, moreLength, crc);
+//
+// the polynomial is expected in the same form as the algorithm processes it:
+// - reflected (LSB-first) CRCs use the bit-reversed polynomial, e.g. zlib's 0xEDB88320
+// - non-reflected (MSB-first) CRCs use the normal polynomial,  e.g. BZIP2's 0x04C11DB7
+
+#pragma once
+
+// uint8_t, uint32_t
+#include <stdint.h>
+// size_t
+#include <cstddef>
+
+
+/// a set of lookup tables for Slicing-by-N
+template <size_t Slices>
+struct CrcTables
+{
+  typedef uint32_t Slice[256];
+  Slice table[Slices];
+
+  /// access a single table
+  constexpr const Slice& operator[](size_t slice) const { return table[slice]; }
+};
+
+
+/// generate lookup tables for Slicing-by-N
+template <uint32_t Poly, bool Reflected, size_t Slices>
+constexpr CrcTables<Slices> makeCrcTables()
+{
+  CrcTables<Slices> result = {};
+
+  // same algorithm as crc32_bitwise
+  for (uint32_t i = 0; i <= 0xFF; i++)
+  {
+    uint32_t crc = Reflected ? i : i << 24;
+    for (int j = 0; j < 8; j++)
+      if (Reflected)
+        crc = (crc >> 1) ^ ((crc & 1) * Poly);
+      else
+        crc = (crc << 1) ^ ((crc >> 31) * Poly);
+    result.table[0][i] = crc;
+  }
+
+  // ... and the following slicing-by-8 algorithm (from Intel):
+  // http://www.intel.com/technology/comms/perfnet/download/CRC_generators.pdf
+  // http://sourceforge.net/projects/slicing-by-8/
+  for (size_t slice = 1; slice < Slices; slice++)
+    for (uint32_t i = 0; i <= 0xFF; i++)
+    {
+      uint32_t previous = result.table[slice - 1][i];
+      if (Reflected)
+        result.table[slice][i] = (previous >> 8) ^ result.table[0][ previous        & 0xFF];
+      else
+        result.table[slice][i] = (previous << 8) ^ result.table[0][(previous >> 24) & 0xFF];
+    }
+
+  return result;
+}
+
+
+/// generic CRC-32, Init and XorOut are applied as in the "Rocksoft model" of CRC algorithms
+template <uint32_t Poly, uint32_t Init, uint32_t XorOut, bool Reflected>
+struct Crc
+{
+  /// CRC of an empty input, default value of previousCrc
+  static const uint32_t Empty = Init ^ XorOut;
+
+  /// Slicing-by-16 needs 16 tables
+  static const size_t MaxSlice = 16;
+  /// lookup tables, generated at compile time
+  static constexpr CrcTables<MaxSlice> Table = makeCrcTables<Poly, Reflected, MaxSlice>();
+
+  /// compute CRC using the fastest algorithm (Slicing-by-16)
+  static uint32_t compute(const void* data, size_t length, uint32_t previousCrc = Empty)
+  {
+    return slicing<16>(data, length, previousCrc);
+  }
+
+  /// compute CRC (standard algorithm, one byte at once)
+  static uint32_t bytewise(const void* data, size_t length, uint32_t previousCrc = Empty)
+  {
+    uint32_t crc = previousCrc ^ XorOut;
+    const uint8_t* current = (const uint8_t*) data;
+
+    while (length-- != 0)
+      crc = update(crc, *current++);
+
+    return crc ^ XorOut;
+  }
+
+  /// compute CRC (Slicing-by-4, Slicing-by-8 or Slicing-by-16 algorithm)
+  template <size_t Slices>
+  static uint32_t slicing(const void* data, size_t length, uint32_t previousCrc = Empty)
+  {
+    static_assert(Slices == 4 || Slices == 8 || Slices == 16, "only Slicing-by-4, Slicing-by-8 and Slicing-by-16 supported");
+
+    uint32_t crc = previousCrc ^ XorOut;
+    const uint8_t* current = (const uint8_t*) data;
+
+    // enabling optimization (at least -O2) automatically unrolls the inner for-loops
+    const size_t Unroll = 64 / Slices;
+    const size_t BytesAtOnce = Slices * Unroll;
+
+    while (length >= BytesAtOnce)
+    {
+      for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
+      {
+        crc = slice<Slices>(crc, current);
+        current += Slices;
+      }
+
+      length -= BytesAtOnce;
+    }
+
+    // remaining 1 to 63 bytes (Slicing-by-N without unrolling, Slicing-by-4 and standard algorithm)
+    for (; length >= Slices; length -= Slices, current += Slices)
+      crc = slice<Slices>(crc, current);
+    if (Slices > 4 && length >= 4)
+    {
+      crc = slice<4>(crc, current);
+      current += 4;
+      length  -= 4;
+    }
+    while (length-- != 0)
+      crc = update(crc, *current++);
+
+    return crc ^ XorOut;
+  }
+
+  /// compute CRC of exactly N bytes, N is known at compile time => all loops are unrolled and all branches removed
+  template <size_t N>
+  static uint32_t fixed(const void* data, uint32_t previousCrc = Empty)
+  {
+    uint32_t crc = previousCrc ^ XorOut;
+    const uint8_t* current = (const uint8_t*) data;
+
+    for (size_t i = 0; i < N / 16; i++, current += 16)
+      crc = slice<16>(crc, current);
+    if (N & 8)
+    {
+      crc = slice<8>(crc, current);
+      current += 8;
+    }
+    if (N & 4)
+    {
+      crc = slice<4>(crc, current);
+      current += 4;
+    }
+    for (size_t i = 0; i < N % 4; i++)
+      crc = update(crc, *current++);
+
+    return crc ^ XorOut;
+  }
+
+private:
+  /// process Slices bytes at once
+  template <size_t Slices>
+  static uint32_t slice(uint32_t crc, const uint8_t* current)
+  {
+    // bytes which depend on the current CRC are processed last (shortest critical path)
+    uint32_t next = 0;
+    for (size_t word = Slices / 4; word-- > 0; )
+    {
+      uint32_t one = Reflected ? load32LittleEndian(current + 4 * word) : load32BigEndian(current + 4 * word);
+      // the first bytes are combined with the current CRC
+      if (word == 0)
+        one ^= crc;
+
+      // byte k of the block needs table Slices-1-k
+      const size_t first = Slices - 1 - 4 * word;
+      if (Reflected)
+        next ^= Table[first - 3][ one >> 24        ] ^
+                Table[first - 2][(one >> 16) & 0xFF] ^
+                Table[first - 1][(one >>  8) & 0xFF] ^
+                Table[first    ][ one        & 0xFF];
+      else
+        next ^= Table[first - 3][ one        & 0xFF] ^
+                Table[first - 2][(one >>  8) & 0xFF] ^
+                Table[first - 1][(one >> 16) & 0xFF] ^
+                Table[first    ][ one >> 24        ];
+    }
+    return next;
+  }
+
+  /// process a single byte
+  static uint32_t update(uint32_t crc, uint8_t one)
+  {
+    if (Reflected)
+      return (crc >> 8) ^ Table[0][(crc & 0xFF) ^ one];
+    else
+      return (crc << 8) ^ Table[0][(crc >> 24) ^ one];
+  }
+
+  // endian-independent loads, GCC and Clang compile them to a single mov (plus bswap if needed)
+  static uint32_t load32LittleEndian(const uint8_t* bytes)
+  {
+    return  uint32_t(bytes[0])        | (uint32_t(bytes[1]) <<  8) |
+           (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+  }
+  static uint32_t load32BigEndian   (const uint8_t* bytes)
+  {
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+           (uint32_t(bytes[2]) <<  8) |  uint32_t(bytes[3]);
+  }
+};
+
+// definition of the static member (only needed prior to C++17)
+template <uint32_t Poly, uint32_t Init, uint32_t XorOut, bool Reflected>
+constexpr CrcTables<Crc<Poly, Init, XorOut, Reflected>::MaxSlice> Crc<Poly, Init, XorOut, Reflected>::Table;
+
+
+// popular CRC-32 variants, see http://reveng.sourceforge.net/crc-catalogue/17plus.htm
+//                      polynomial  init        xorout      reflected        check ("123456789")
+/// zlib, PNG, Ethernet (same as crc32_fast)
+typedef Crc<0xEDB88320, 0xFFFFFFFF, 0xFFFFFFFF, true > Crc32Zlib;       // 0xCBF43926
+/// BZIP2, AAL5, DECT-B
+typedef Crc<0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, false> Crc32Bzip2;      // 0xFC891918
+/// MPEG-2
+typedef Crc<0x04C11DB7, 0xFFFFFFFF, 0x00000000, false> Crc32Mpeg2;      // 0x0376E6E7
+/// Castagnoli: iSCSI, ext4, Btrfs, SCTP (same as crc32c_fast)
+typedef Crc<0x82F63B78, 0xFFFFFFFF, 0xFFFFFFFF, true > Crc32Castagnoli; // 0xE3069283
+/// Koopman
+typedef Crc<0xEB31D82E, 0xFFFFFFFF, 0xFFFFFFFF, true > Crc32Koopman;    // 0x2D3DD0AE
@@ -0,0 +1,239 @@
+// //////////////////////////////////////////////////////////
+// Crc32Index.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+#include "Crc32Index.h"
+
+#include <cstdio>
+#include <cstring>
+
+
+namespace
+{
+  /// sidecar file: magic bytes, version, block size, length, CRC32 of each block, CRC32 of everything before
+  /// (all numbers are little endian)
+  const char     Magic[8] = { 'C', 'R', 'C', '3', '2', 'I', 'D', 'X' };
+  const uint32_t Version  = 1;
+  /// magic bytes, version, block size and length
+  const size_t   HeaderSize = 8 + 4 + 8 + 8;
+
+  /// append a little endian number
+  void writeNumber(std::vector<uint8_t>& buffer, uint64_t value, size_t numBytes)
+  {
+    for (size_t i = 0; i < numBytes; i++)
+      buffer.push_back(uint8_t(value >> (8 * i)));
+  }
+
+  /// read a little endian number
+  uint64_t readNumber(const uint8_t* buffer, size_t numBytes)
+  {
+    uint64_t value = 0;
+    for (size_t i = 0; i < numBytes; i++)
+      value |= uint64_t(buffer[i]) << (8 * i);
+    return value;
+  }
+} // anonymous namespace
+
+
+/// empty index
+Crc32Index::Crc32Index(size_t blockSize)
+: m_blockSize(blockSize > 0 ? blockSize : 1),
+  m_length(0),
+  m_blocks(),
+  m_prefix(1, 0),
+  m_shift(m_blockSize)
+{
+}
+
+
+/// hash all blocks of data
+void Crc32Index::build(const void* data, size_t length)
+{
+  clear();
+  append(data, length);
+}
+
+
+/// hash more data
+void Crc32Index::append(const void* data, size_t length)
+{
+  const uint8_t* current = (const uint8_t*) data;
+  while (length > 0)
+  {
+    // start a new block or continue an incomplete one
+    size_t used = m_length % m_blockSize;
+    if (used == 0)
+      m_blocks.push_back(0);
+
+    size_t chunk = m_blockSize - used;
+    if (chunk > length)
+      chunk = length;
+
+    m_blocks.back() = crc32_fast(current, chunk, m_blocks.back());
+    m_length += chunk;
+    current  += chunk;
+    length   -= chunk;
+
+    // block is complete
+    if (m_length % m_blockSize == 0)
+      m_prefix.push_back(m_shift.combine(m_prefix.back(), m_blocks.back()));
+  }
+}
+
+
+/// remove all blocks
+void Crc32Index::clear(size_t blockSize)
+{
+  if (blockSize > 0 && blockSize != m_blockSize)
+  {
+    m_blockSize = blockSize;
+    m_shift     = Crc32Shift(blockSize);
+  }
+
+  m_length = 0;
+  m_blocks.clear();
+  m_prefix.assign(1, 0);
+}
+
+
+/// CRC32 of bytes [begin, end)
+uint32_t Crc32Index::crc32(size_t begin, size_t end, const void* slice) const
+{
+  // nothing beyond the indexed data
+  if (end > m_length)
+    end = m_length;
+  if (begin >= end)
+    return 0;
+
+  // complete blocks first .. last-1
+  size_t first = (begin + m_blockSize - 1) / m_blockSize;
+  size_t last  =  end                      / m_blockSize;
+  // too short
+  if (first >= last)
+    return crc32_fast(slice, end - begin);
+
+  const uint8_t* current = (const uint8_t*) slice;
+  size_t head   = first * m_blockSize - begin;
+  size_t middle = (last - first) * m_blockSize;
+  size_t tail   = end - last * m_blockSize;
+
+  // partial block at the beginning
+  uint32_t crc = crc32_fast(current, head);
+
+  // m_prefix[last] = crc32_combine(m_prefix[first], middleCrc, middle) can be solved for middleCrc, too:
+  // middleCrc = crc32_combine(m_prefix[first], m_prefix[last], middle) because combining means appending zeros
+  // to the first CRC and XORing the second CRC; the zeros appended to crc and m_prefix[first] can be merged
+  // => crc32_combine(crc, middleCrc, middle) = crc32_combine(crc ^ m_prefix[first], m_prefix[last], middle)
+  crc = crc32_combine(crc ^ m_prefix[first], m_prefix[last], middle);
+
+  // partial block at the end
+  return crc32_fast(current + head + middle, tail, crc);
+}
+
+
+/// CRC32 of all data
+uint32_t Crc32Index::crc32() const
+{
+  // all blocks are complete
+  size_t incomplete = m_length % m_blockSize;
+  if (incomplete == 0)
+    return m_prefix.back();
+
+  return crc32_combine(m_prefix.back(), m_blocks.back(), incomplete);
+}
+
+
+/// indices of all blocks whose CRC32 doesn't match
+std::vector<size_t> Crc32Index::findCorruptBlocks(const void* data, size_t length) const
+{
+  const uint8_t* current = (const uint8_t*) data;
+
+  std::vector<size_t> result;
+  for (size_t i = 0; i < m_blocks.size(); i++)
+  {
+    size_t offset      = i * m_blockSize;
+    size_t blockLength = m_length - offset;
+    if (blockLength > m_blockSize)
+      blockLength = m_blockSize;
+
+    // truncated data is corrupt, too
+    if (offset + blockLength > length || crc32_fast(current + offset, blockLength) != m_blocks[i])
+      result.push_back(i);
+  }
+
+  return result;
+}
+
+
+/// write index to disk
+bool Crc32Index::save(const char* filename) const
+{
+  std::vector<uint8_t> buffer(Magic, Magic + sizeof(Magic));
+  writeNumber(buffer, Version,     4);
+  writeNumber(buffer, m_blockSize, 8);
+  writeNumber(buffer, m_length,    8);
+  for (auto crc : m_blocks)
+    writeNumber(buffer, crc,       4);
+  // detect a corrupted index, too
+  writeNumber(buffer, crc32_fast(buffer.data(), buffer.size()), 4);
+
+  FILE* file = fopen(filename, "wb");
+  if (!file)
+    return false;
+
+  bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  // flush and check for write errors
+  ok = (fclose(file) == 0) && ok;
+  return ok;
+}
+
+
+/// read index from disk
+bool Crc32Index::load(const char* filename)
+{
+  FILE* file = fopen(filename, "rb");
+  if (!file)
+    return false;
+
+  // read whole file
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[4096];
+  size_t numRead;
+  while ((numRead = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    buffer.insert(buffer.end(), chunk, chunk + numRead);
+  bool ok = !ferror(file);
+  fclose(file);
+
+  // header and checksum
+  if (!ok || buffer.size() < HeaderSize + 4 || memcmp(buffer.data(), Magic, sizeof(Magic)) != 0)
+    return false;
+  size_t checked = buffer.size() - 4;
+  if (readNumber(buffer.data() + checked, 4) != crc32_fast(buffer.data(), checked))
+    return false;
+
+  uint64_t version   = readNumber(buffer.data() +  8, 4);
+  uint64_t blockSize = readNumber(buffer.data() + 12, 8);
+  uint64_t length    = readNumber(buffer.data() + 20, 8);
+  // block size and length must fit into size_t (32 bit systems)
+  if (version != Version || blockSize == 0 || blockSize != size_t(blockSize) || length != size_t(length))
+    return false;
+
+  // one CRC32 per block
+  uint64_t numBlocks = length / blockSize + (length % blockSize != 0 ? 1 : 0);
+  if (checked != HeaderSize + 4 * numBlocks)
+    return false;
+
+  clear(size_t(blockSize));
+  m_length = size_t(length);
+  for (size_t i = 0; i < numBlocks; i++)
+  {
+    m_blocks.push_back(uint32_t(readNumber(buffer.data() + HeaderSize + 4 * i, 4)));
+    // only complete blocks
+    if ((i + 1) * m_blockSize <= m_length)
+      m_prefix.push_back(m_shift.combine(m_prefix.back(), m_blocks.back()));
+  }
+
+  return true;
+}
@@ -0,0 +1,66 @@
+// //////////////////////////////////////////////////////////
+// Crc32Index.h
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// CRC32 of each block of a large buffer or file: CRC32 of arbitrary ranges without processing them again,
+// find corrupted blocks, store the index in a small sidecar file
+
+#pragma once
+
+#include "Crc32.h"
+
+#include <vector>
+
+
+/// per-block CRC32 of immutable data
+class Crc32Index
+{
+public:
+  /// empty index, blocks of blockSize bytes (default: 64 KB)
+  explicit Crc32Index(size_t blockSize = 64*1024);
+
+  /// hash all blocks of data, replaces the current index
+  void build(const void* data, size_t length);
+  /// hash more data, e.g. the next chunk of a file (may end in the middle of a block)
+  void append(const void* data, size_t length);
+  /// remove all blocks (and optionally change the block size)
+  void clear(size_t blockSize = 0);
+
+  /// CRC32 of bytes [begin, end): complete blocks are taken from the index in O(log n),
+  /// only the partial blocks at both ends are hashed, slice points to the data of this range
+  /// (end is clamped to getLength())
+  uint32_t crc32(size_t begin, size_t end, const void* slice) const;
+  /// CRC32 of all data
+  uint32_t crc32() const;
+
+  /// indices of all blocks whose CRC32 doesn't match, data must start at the beginning of the indexed data
+  std::vector<size_t> findCorruptBlocks(const void* data, size_t length) const;
+
+  /// write index to disk, false on error
+  bool save(const char* filename) const;
+  /// read index from disk, false on error (then the index is left unchanged)
+  bool load(const char* filename);
+
+  /// bytes per block
+  size_t   getBlockSize() const { return m_blockSize; }
+  /// number of indexed bytes
+  size_t   getLength()    const { return m_length; }
+  /// number of blocks (the last one may be incomplete)
+  size_t   getNumBlocks() const { return m_blocks.size(); }
+  /// CRC32 of a single block
+  uint32_t getBlockCrc(size_t index) const { return m_blocks[index]; }
+
+private:
+  /// bytes per block
+  size_t m_blockSize;
+  /// number of indexed bytes
+  size_t m_length;
+  /// CRC32 of each block
+  std::vector<uint32_t> m_blocks;
+  /// m_prefix[i] = CRC32 of the first i complete blocks
+  std::vector<uint32_t> m_prefix;
+  /// merge CRC32s of whole blocks
+  Crc32Shift m_shift;
+};
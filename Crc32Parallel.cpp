@@ -0,0 +1,210 @@
+// //////////////////////////////////////////////////////////
+// Crc32Parallel.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+#include "Crc32Parallel.h"
+
+
+namespace
+{
+  /// default of Crc32ThreadPool::setMinBlockSize
+  size_t defaultMinBlockSize()
+  {
+#ifdef CRC32_USE_PROFILE
+    size_t tuned = crc32_get_profile().parallelMinBlockSize;
+    if (tuned > 0)
+      return tuned;
+#endif
+    return 512*1024;
+  }
+} // anonymous namespace
+
+
+/// create numThreads - 1 worker threads, 0 => one thread per CPU core
+Crc32ThreadPool::Crc32ThreadPool(size_t numThreads)
+: m_workers(),
+  m_minBlockSize(defaultMinBlockSize()),
+  m_task(0),
+  m_context(0),
+  m_numTasks(0),
+  m_nextTask(0),
+  m_doneTasks(0),
+  m_quit(false)
+{
+  // run on all cores
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+
+  // the calling thread does some work, too
+  for (size_t i = 1; i < numThreads; i++)
+    m_workers.push_back(std::thread(&Crc32ThreadPool::work, this));
+}
+
+
+/// stop all threads
+Crc32ThreadPool::~Crc32ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wakeUp.notify_all();
+
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+
+/// run all tasks on all threads and return when all are finished
+void Crc32ThreadPool::run(Task task, void* context, size_t numTasks)
+{
+  if (numTasks == 0)
+    return;
+
+  // only one job at a time
+  std::lock_guard<std::mutex> runLock(m_runMutex);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_task      = task;
+  m_context   = context;
+  m_numTasks  = numTasks;
+  m_nextTask  = 0;
+  m_doneTasks = 0;
+  m_wakeUp.notify_all();
+
+  // help the workers
+  processTasks(lock);
+
+  // wait until workers finished their last tasks
+  m_finished.wait(lock, [this] { return m_doneTasks == m_numTasks; });
+
+  // job is done
+  m_task     = 0;
+  m_context  = 0;
+  m_numTasks = 0;
+  m_nextTask = 0;
+}
+
+
+/// main loop of each worker thread
+void Crc32ThreadPool::work()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    // sleep until there is something to do
+    m_wakeUp.wait(lock, [this] { return m_quit || m_nextTask < m_numTasks; });
+    if (m_quit)
+      return;
+
+    processTasks(lock);
+  }
+}
+
+
+/// fetch and run tasks until none is left, mutex must be locked
+void Crc32ThreadPool::processTasks(std::unique_lock<std::mutex>& lock)
+{
+  while (m_nextTask < m_numTasks)
+  {
+    size_t index  = m_nextTask++;
+    Task   task   = m_task;
+    void* context = m_context;
+
+    // don't block other threads while working
+    lock.unlock();
+    task(index, context);
+    lock.lock();
+
+    // last one ?
+    if (++m_doneTasks == m_numTasks)
+      m_finished.notify_all();
+  }
+}
+
+
+namespace
+{
+  /// split data into equally-sized blocks, the last one may be smaller
+  struct ParallelJob
+  {
+    Crc32Function algorithm;
+    const char*   data;
+    size_t        length;
+    size_t        blockSize;
+    uint32_t      previousCrc32;
+    /// results, one per block
+    uint32_t*     crcs;
+  };
+
+  /// compute CRC32 of a single block
+  void processBlock(size_t index, void* context)
+  {
+    ParallelJob& job = *(ParallelJob*)context;
+
+    size_t offset = index * job.blockSize;
+    size_t length = job.blockSize;
+    if (length > job.length - offset)
+      length = job.length - offset;
+
+    // only the first block continues the previous CRC
+    uint32_t previous = (index == 0) ? job.previousCrc32 : 0;
+    job.crcs[index] = job.algorithm(job.data + offset, length, previous);
+  }
+} // anonymous namespace
+
+
+/// compute CRC32 with multiple threads
+uint32_t crc32_parallel(const void* data, size_t length, uint32_t previousCrc32,
+                        Crc32ThreadPool* pool, Crc32Function algorithm)
+{
+  // shared pool, created when needed for the first time
+  if (pool == 0)
+  {
+    static Crc32ThreadPool defaultPool;
+    pool = &defaultPool;
+  }
+
+  // one block per thread, but not too small
+  size_t numBlocks = pool->getNumThreads();
+  size_t minBlockSize = pool->getMinBlockSize();
+  if (minBlockSize == 0)
+    minBlockSize = 1;
+  if (numBlocks > length / minBlockSize)
+    numBlocks = length / minBlockSize;
+
+  // not worth the effort
+  if (numBlocks <= 1)
+    return algorithm(data, length, previousCrc32);
+
+  // split data evenly, rounding up to multiples of 64 bytes (whole cache lines, SIMD-friendly)
+  size_t blockSize = (length + numBlocks - 1) / numBlocks;
+#ifdef CRC32_USE_PROFILE
+  // more, smaller tasks if a profile found them to be faster (load balancing, cache-friendly)
+  size_t tunedBlockSize = crc32_get_profile().parallelBlockSize;
+  if (tunedBlockSize > 0 && blockSize > tunedBlockSize)
+    blockSize = tunedBlockSize;
+#endif
+  blockSize = (blockSize + 63) & ~size_t(63);
+  numBlocks = (length + blockSize - 1) / blockSize;
+
+  std::vector<uint32_t> crcs   (numBlocks);
+  std::vector<size_t>   lengths(numBlocks, blockSize);
+  lengths.back() = length - (numBlocks - 1) * blockSize;
+
+  ParallelJob job = { algorithm, (const char*)data, length, blockSize, previousCrc32, crcs.data() };
+  pool->run(processBlock, &job, numBlocks);
+
+  // merge neighbors in a balanced tree: log2(numBlocks) levels
+  for (size_t distance = 1; distance < numBlocks; distance *= 2)
+    for (size_t left = 0; left + distance < numBlocks; left += 2 * distance)
+    {
+      size_t right = left + distance;
+      crcs   [left]  = crc32_combine(crcs[left], crcs[right], lengths[right]);
+      lengths[left] += lengths[right];
+    }
+
+  return crcs[0];
+}
@@ -0,0 +1,81 @@
+// //////////////////////////////////////////////////////////
+// Crc32Parallel.h
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// multi-threaded CRC32: split data into blocks, process them on a persistent pool of threads
+// and merge the results with crc32_combine (requires C++11 threads, link with -pthread)
+
+#pragma once
+
+#include "Crc32.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+/// worker threads are created once and sleep while idle
+class Crc32ThreadPool
+{
+public:
+  /// create numThreads - 1 worker threads (the calling thread participates, too), 0 => one thread per CPU core
+  explicit Crc32ThreadPool(size_t numThreads = 0);
+  /// stop all threads
+  ~Crc32ThreadPool();
+
+  /// number of threads including the calling thread
+  size_t getNumThreads() const { return m_workers.size() + 1; }
+
+  /// blocks smaller than this are processed single-threaded (default: 512 KB or as specified by Crc32Profile)
+  size_t getMinBlockSize() const { return m_minBlockSize; }
+  /// blocks smaller than this are processed single-threaded
+  void   setMinBlockSize(size_t minBlockSize) { m_minBlockSize = minBlockSize; }
+
+  /// a task which will be invoked for index = 0 .. numTasks-1
+  typedef void (*Task)(size_t index, void* context);
+  /// run all tasks on all threads and return when all are finished (only one job at a time)
+  void run(Task task, void* context, size_t numTasks);
+
+private:
+  /// no copies
+  Crc32ThreadPool(const Crc32ThreadPool&);
+  Crc32ThreadPool& operator=(const Crc32ThreadPool&);
+
+  /// main loop of each worker thread
+  void work();
+  /// fetch and run tasks until none is left, mutex must be locked
+  void processTasks(std::unique_lock<std::mutex>& lock);
+
+  /// all worker threads
+  std::vector<std::thread> m_workers;
+  /// blocks smaller than this are processed single-threaded
+  size_t m_minBlockSize;
+
+  /// serialize concurrent calls of run()
+  std::mutex m_runMutex;
+  /// protects all following members
+  std::mutex m_mutex;
+  /// wake up workers when a new job arrives or the pool is destroyed
+  std::condition_variable m_wakeUp;
+  /// notify run() when all tasks are finished
+  std::condition_variable m_finished;
+
+  /// current job
+  Task   m_task;
+  void*  m_context;
+  size_t m_numTasks;
+  /// next task index
+  size_t m_nextTask;
+  /// number of completed tasks
+  size_t m_doneTasks;
+  /// true if pool is destroyed
+  bool   m_quit;
+};
+
+
+/// compute CRC32 with multiple threads, pool = 0 => use a shared pool with one thread per CPU core
+uint32_t crc32_parallel(const void* data, size_t length, uint32_t previousCrc32 = 0,
+                        Crc32ThreadPool* pool = 0, Crc32Function algorithm = crc32_fast);
@@ -0,0 +1,283 @@
+// //////////////////////////////////////////////////////////
+// Crc32Sum.cpp
+// Copyright (c) 2019 Stephan Brumme. All rights reserved.
+// see http://create.stephan-brumme.com/disclaimer.html
+//
+
+// command-line tool: print CRC32 (zlib/PNG/Ethernet polynomial, same as cksum -a crc32b), size and name of each file
+// usage: crc32sum [-j threads] [-p | -d | -s] [file ...]   (no file or "-" => read from stdin)
+// POSIX only (mmap, io_uring on Linux)
+
+// 64 bit file offsets on 32 bit systems (must be identical in all translation units, the Makefile defines it, too)
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "Crc32File.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/// map at most 1 GB at once (256 MB on 32 bit systems), files can be larger than RAM and address space
+const size_t WindowSize = sizeof(void*) >= 8 ? 1024*1024*1024 : 256*1024*1024;
+/// read this many bytes at once if a file can't be mapped (pipes, stdin, ...)
+const size_t ReadSize   = 16*1024*1024;
+/// larger values of -j are reduced to this
+const long   MaxThreads = 1024;
+
+
+/// parse the argument of -j, false if it's not a non-negative number
+static bool parseThreads(const char* text, size_t& numThreads)
+{
+  char* end;
+  long value = strtol(text, &end, 10);
+  if (end == text || *end != 0 || value < 0)
+    return false;
+
+  // huge numbers overflow to LONG_MAX (errno = ERANGE)
+  if (value > MaxThreads)
+    value = MaxThreads;
+  numThreads = size_t(value);
+  return true;
+}
+
+
+/// hash everything returned by read(), false on error
+static bool hashStream(int fd, Crc32ThreadPool& pool, uint32_t& crc, uint64_t& size)
+{
+  static std::vector<char> buffer(ReadSize);
+
+  while (true)
+  {
+    // fill the buffer as far as possible, pipes often return only a few kilobytes per call
+    size_t filled = 0;
+    while (filled < ReadSize)
+    {
+      ssize_t numRead = read(fd, buffer.data() + filled, ReadSize - filled);
+      if (numRead == 0)
+        break;
+      if (numRead < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      filled += size_t(numRead);
+    }
+
+    crc   = crc32_parallel(buffer.data(), filled, crc, &pool);
+    size += filled;
+
+    // end of file ?
+    if (filled < ReadSize)
+      return true;
+  }
+}
+
+
+/// map a part of a regular file window by window, false on error
+static bool hashMapped(int fd, uint64_t begin, uint64_t end, Crc32ThreadPool& pool, uint32_t& crc, uint64_t& size)
+{
+  // mmap requires offsets to be multiples of the page size
+  const uint64_t PageMask = uint64_t(sysconf(_SC_PAGESIZE)) - 1;
+
+  for (uint64_t offset = begin; offset < end; )
+  {
+    size_t skip   = size_t(offset & PageMask);
+    size_t length = (end - offset < WindowSize - skip) ? size_t(end - offset) : WindowSize - skip;
+
+    void* window = mmap(NULL, skip + length, PROT_READ, MAP_PRIVATE, fd, off_t(offset - skip));
+    if (window == MAP_FAILED)
+      return false;
+    // read-ahead as far as possible, pages can be discarded soon
+    madvise(window, skip + length, MADV_SEQUENTIAL);
+
+    crc   = crc32_parallel((const char*)window + skip, length, crc, &pool);
+    size += length;
+
+    munmap(window, skip + length);
+    offset += length;
+  }
+
+  return true;
+}
+
+
+/// map only the data regions of a sparse file, holes are processed by crc32_zeros without reading them
+static bool hashSparse(int fd, uint64_t fileSize, Crc32ThreadPool& pool, uint32_t& crc, uint64_t& size)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  uint64_t offset = 0;
+  while (offset < fileSize)
+  {
+    off_t data = lseek(fd, off_t(offset), SEEK_DATA);
+    if (data < 0)
+    {
+      // file system doesn't know about holes
+      if (errno == EINVAL && offset == 0)
+        return hashMapped(fd, 0, fileSize, pool, crc, size);
+      // nothing but a hole until the end of file
+      if (errno != ENXIO)
+        return false;
+      data = off_t(fileSize);
+    }
+
+    // skip hole (in steps that fit into size_t on 32 bit systems)
+    uint64_t dataBegin = (uint64_t(data) < fileSize) ? uint64_t(data) : fileSize;
+    while (offset < dataBegin)
+    {
+      size_t numZeros = (dataBegin - offset < WindowSize) ? size_t(dataBegin - offset) : WindowSize;
+      crc     = crc32_zeros(crc, numZeros);
+      size   += numZeros;
+      offset += numZeros;
+    }
+    if (offset == fileSize)
+      break;
+
+    // process data until the next hole
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    if (hole < 0)
+      return false;
+    uint64_t dataEnd = (uint64_t(hole) < fileSize) ? uint64_t(hole) : fileSize;
+    if (!hashMapped(fd, dataBegin, dataEnd, pool, crc, size))
+      return false;
+    offset = dataEnd;
+  }
+  return true;
+#else
+  // holes can't be detected
+  return hashMapped(fd, 0, fileSize, pool, crc, size);
+#endif
+}
+
+
+/// how regular files are processed
+enum ReadMode
+{
+  /// mmap and crc32_parallel
+  Mapped,
+  /// crc32_file: asynchronous reads overlap with hashing
+  Pipelined,
+  /// crc32_file with O_DIRECT, bypasses the page cache
+  Direct,
+  /// mmap only the data of a sparse file, holes are handled by crc32_zeros
+  Sparse
+};
+
+
+/// compute CRC32 of a file or stdin (filename = NULL), print an error message and return false on failure
+static bool hashFile(const char* filename, ReadMode mode, Crc32ThreadPool& pool)
+{
+  int fd = STDIN_FILENO;
+  if (filename != NULL)
+  {
+    fd = -1;
+    // not every file system supports O_DIRECT
+    if (mode == Direct)
+      fd = open(filename, O_RDONLY | O_DIRECT);
+    if (fd < 0)
+      fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", filename, strerror(errno));
+      return false;
+    }
+  }
+
+  uint32_t crc  = 0;
+  uint64_t size = 0;
+
+  // regular files are memory-mapped, everything else is read sequentially
+  struct stat info;
+  bool ok;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+  {
+    uint64_t fileSize = uint64_t(info.st_size);
+    if (mode == Pipelined || mode == Direct)
+      ok = crc32_file(fd, crc, size);
+    else
+    {
+      ok = (mode == Sparse) ? hashSparse(fd, fileSize, pool, crc, size)
+                            : hashMapped(fd, 0, fileSize, pool, crc, size);
+
+      // some file systems don't support mmap: start over with read()
+      if (!ok && errno == ENODEV && lseek(fd, 0, SEEK_SET) == 0)
+      {
+        crc  = 0;
+        size = 0;
+        ok   = hashStream(fd, pool, crc, size);
+      }
+    }
+  }
+  else
+    ok = hashStream(fd, pool, crc, size);
+
+  if (!ok)
+    fprintf(stderr, "crc32sum: %s: %s\n", filename ? filename : "-", strerror(errno));
+  else if (filename != NULL)
+    printf("%u %llu %s\n", crc, (unsigned long long) size, filename);
+  else
+    printf("%u %llu\n",    crc, (unsigned long long) size);
+
+  if (filename != NULL)
+    close(fd);
+
+  return ok;
+}
+
+
+int main(int argc, char* argv[])
+{
+  // parse options
+  size_t   numThreads = 0; // all cores
+  ReadMode mode       = Mapped;
+  int first = 1;
+  for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++)
+  {
+    if (strcmp(argv[first], "-j") == 0 && first + 1 < argc && parseThreads(argv[first + 1], numThreads))
+      first++;
+    else if (strcmp(argv[first], "-p") == 0)
+      mode = Pipelined;
+    else if (strcmp(argv[first], "-d") == 0)
+      mode = Direct;
+    else if (strcmp(argv[first], "-s") == 0)
+      mode = Sparse;
+    else
+    {
+      bool help = strcmp(argv[first], "-h") == 0 || strcmp(argv[first], "--help") == 0;
+      fprintf(help ? stdout : stderr,
+             "usage: crc32sum [-j threads] [-p | -d | -s] [file ...]\n"
+             "prints CRC32, size and name of each file (same format as cksum -a crc32b)\n"
+             "read from stdin if no file is given or file is -\n"
+             "  -j  number of threads (default or 0: all cores, at most 1024)\n"
+             "  -p  pipelined reads instead of mmap (io_uring or a reader thread), single-threaded hashing\n"
+             "  -d  like -p but bypass the page cache (O_DIRECT)\n"
+             "  -s  sparse files: skip holes instead of reading their zeros\n");
+      return help ? 0 : 1;
+    }
+  }
+
+  Crc32ThreadPool pool(numThreads);
+
+  // no files => stdin
+  if (first == argc)
+    return hashFile(NULL, mode, pool) ? 0 : 1;
+
+  bool ok = true;
+  for (int i = first; i < argc; i++)
+  {
+    const char* filename = (strcmp(argv[i], "-") == 0) ? NULL : argv[i];
+    if (!hashFile(filename, mode, pool))
+      ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -5,8 +5,12 @@
 //
 
 #include "Crc32.h"
+#include "Crc32Generic.h"
+#include "Crc32Chunker.h"
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <vector>
 
 // the slicing-by-4/8/16 tests are only performed if the corresponding
 // preprocessor symbol is defined in Crc32.h
@@ -14,6 +18,7 @@
 #define CRC32_TEST_BITWISE
 #define CRC32_TEST_HALFBYTE
 #define CRC32_TEST_TABLELESS
+#define CRC32_TEST_ALIGNMENT
 
 // //////////////////////////////////////////////////////////
 // test code
@@ -22,6 +27,17 @@
 const size_t NumBytes = 1024*1024*1024;
 /// 4k chunks during last test
 const size_t DefaultChunkSize = 4*1024;
+/// tiny fragments for the streaming test
+const size_t SmallChunkSize = 37;
+/// shortest and longest message for the batch test
+const size_t MinMessageSize = 40;
+const size_t MaxMessageSize = 300;
+/// sliding window for the rolling CRC test
+const size_t RollingWindowSize = 64;
+/// bytes processed by the chunking test
+const size_t ChunkingTestSize = 256*1024*1024;
+/// bytes per offset during the alignment test
+const size_t AlignmentTestSize = 16*1024*1024;
 
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -130,6 +146,13 @@ int main(int, char**)
   duration  = seconds() - startTime;
   printf("4x8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
          crc, duration, (NumBytes / (1024*1024)) / duration);
+
+  // eight bytes at once, four interleaved lanes
+  startTime = seconds();
+  crc = crc32_8bytes_interleaved(data, NumBytes);
+  duration  = seconds() - startTime;
+  printf("  8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s (four lanes)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration);
 #endif // CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
 
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
@@ -148,6 +171,59 @@ int main(int, char**)
          crc, duration, (NumBytes / (1024*1024)) / duration);
 #endif // CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
 
+#ifdef CRC32_USE_PCLMULQDQ
+  // carry-less multiplication, 64 bytes at once
+  if (crc32_pclmul_supported())
+  {
+    startTime = seconds();
+    crc = crc32_pclmul(data, NumBytes);
+    duration  = seconds() - startTime;
+    printf(" carry-less mult.: CRC=%08X, %.3fs, %.3f MB/s\n",
+           crc, duration, (NumBytes / (1024*1024)) / duration);
+  }
+#endif // CRC32_USE_PCLMULQDQ
+
+#ifdef CRC32_USE_VPCLMULQDQ
+  // carry-less multiplication, 256 bytes at once
+  if (crc32_vpclmul_supported())
+  {
+    startTime = seconds();
+    crc = crc32_vpclmul(data, NumBytes);
+    duration  = seconds() - startTime;
+    printf(" carry-less mult.: CRC=%08X, %.3fs, %.3f MB/s (AVX-512)\n",
+           crc, duration, (NumBytes / (1024*1024)) / duration);
+  }
+#endif // CRC32_USE_VPCLMULQDQ
+
+  // other polynomials produce different CRCs
+  // BZIP2 is a non-reflected CRC (generic engine, Slicing-by-16)
+  startTime = seconds();
+  crc = Crc32Bzip2::compute(data, NumBytes);
+  duration  = seconds() - startTime;
+  printf("BZIP2   16 bytes : CRC=%08X, %.3fs, %.3f MB/s\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration);
+
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  // sixteen bytes at once
+  startTime = seconds();
+  crc = crc32c_16bytes(data, NumBytes);
+  duration  = seconds() - startTime;
+  printf("CRC-32C 16 bytes : CRC=%08X, %.3fs, %.3f MB/s\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration);
+#endif // CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+
+#ifdef CRC32_USE_SSE42
+  // crc32 instruction
+  if (crc32c_sse42_supported())
+  {
+    startTime = seconds();
+    crc = crc32c_sse42(data, NumBytes);
+    duration  = seconds() - startTime;
+    printf("CRC-32C SSE4.2   : CRC=%08X, %.3fs, %.3f MB/s\n",
+           crc, duration, (NumBytes / (1024*1024)) / duration);
+  }
+#endif // CRC32_USE_SSE42
+
   // process in 4k chunks
   startTime = seconds();
   crc = 0; // also default parameter of crc32_xx functions
@@ -162,9 +238,163 @@ int main(int, char**)
     bytesProcessed += chunkSize;
   }
   duration  = seconds() - startTime;
-  printf("    chunked      : CRC=%08X, %.3fs, %.3f MB/s\n",
+  printf("    chunked      : CRC=%08X, %.3fs, %.3f MB/s (%s)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration, crc32_fast_algorithm());
+
+  // tiny fragments, e.g. received from a network socket
+  startTime = seconds();
+  crc = 0;
+  for (size_t i = 0; i < NumBytes; i += SmallChunkSize)
+    crc = crc32_fast(data + i, (SmallChunkSize < NumBytes - i) ? SmallChunkSize : NumBytes - i, crc);
+  duration  = seconds() - startTime;
+  printf("    fragments    : CRC=%08X, %.3fs, %.3f MB/s (%d bytes each)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration, int(SmallChunkSize));
+
+  // same fragments, but collected by the streaming interface
+  startTime = seconds();
+  Crc32 stream;
+  for (size_t i = 0; i < NumBytes; i += SmallChunkSize)
+    stream.update(data + i, (SmallChunkSize < NumBytes - i) ? SmallChunkSize : NumBytes - i);
+  crc = stream.finalize();
+  duration  = seconds() - startTime;
+  printf("    streaming    : CRC=%08X, %.3fs, %.3f MB/s (%d bytes each)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration, int(SmallChunkSize));
+
+  // many independent short messages of random length
+  std::vector<const void*> messages;
+  std::vector<size_t>      messageSizes;
+  size_t messageBytes = 0;
+  while (true)
+  {
+    size_t size = MinMessageSize + randomNumber % (MaxMessageSize - MinMessageSize + 1);
+    randomNumber = 1664525 * randomNumber + 1013904223;
+    if (messageBytes + size > NumBytes)
+      break;
+
+    messages    .push_back(data + messageBytes);
+    messageSizes.push_back(size);
+    messageBytes += size;
+  }
+  std::vector<uint32_t> messageCrcs(messages.size());
+
+  // one call per message, "CRC" is the XOR of all messages' CRCs
+  startTime = seconds();
+  for (size_t i = 0; i < messages.size(); i++)
+    messageCrcs[i] = crc32_fast(messages[i], messageSizes[i]);
+  duration  = seconds() - startTime;
+  crc = 0;
+  for (auto messageCrc : messageCrcs)
+    crc ^= messageCrc;
+  printf("    messages     : CRC=%08X, %.3fs, %.3f MB/s (%d to %d bytes each)\n",
+         crc, duration, (messageBytes / (1024*1024)) / duration, int(MinMessageSize), int(MaxMessageSize));
+
+  // same messages, processed by the batch interface
+  startTime = seconds();
+  crc32_batch(messages.data(), messageSizes.data(), messageCrcs.data(), messages.size());
+  duration  = seconds() - startTime;
+  crc = 0;
+  for (auto messageCrc : messageCrcs)
+    crc ^= messageCrc;
+  printf("    batch        : CRC=%08X, %.3fs, %.3f MB/s (%d to %d bytes each)\n",
+         crc, duration, (messageBytes / (1024*1024)) / duration, int(MinMessageSize), int(MaxMessageSize));
+
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+  // CRC32 of each window, e.g. to find matching blocks like rsync, "CRC" is the XOR of all windows' CRCs
+  startTime = seconds();
+  Crc32Rolling rolling(RollingWindowSize);
+  crc = rolling.reset(data);
+  for (size_t i = RollingWindowSize; i < NumBytes; i++)
+    crc ^= rolling.roll(uint8_t(data[i - RollingWindowSize]), uint8_t(data[i]));
+  duration  = seconds() - startTime;
+  printf("    rolling      : CRC=%08X, %.3fs, %.3f MB/s (%d bytes window)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration, int(RollingWindowSize));
+
+  // content-defined chunks including each chunk's CRC32, "CRC" is the XOR of all chunks' CRCs
+  // (data repeats every 256 bytes because of its LCG => use the LCG's highest bits instead)
+  std::vector<char> chunkData(ChunkingTestSize);
+  for (auto& x : chunkData)
+  {
+    x = char(randomNumber >> 24);
+    randomNumber = 1664525 * randomNumber + 1013904223;
+  }
+  startTime = seconds();
+  Crc32Chunker chunker;
+  crc = 0;
+  size_t numChunks = 0;
+  for (size_t i = 0; i < ChunkingTestSize; numChunks++)
+  {
+    uint32_t chunkCrc;
+    i   += chunker.next(chunkData.data() + i, ChunkingTestSize - i, chunkCrc);
+    crc ^= chunkCrc;
+  }
+  duration  = seconds() - startTime;
+  printf("    chunking     : CRC=%08X, %.3fs, %.3f MB/s (%d bytes per chunk)\n",
+         crc, duration, (ChunkingTestSize / (1024*1024)) / duration, int(ChunkingTestSize / numChunks));
+#endif
+
+  // copy to another buffer and compute CRC32 of the copy: two passes vs. a single pass
+  char* copy = new char[NumBytes];
+  memset(copy, 0, NumBytes);
+  startTime = seconds();
+  memcpy(copy, data, NumBytes);
+  crc = crc32_fast(copy, NumBytes);
+  duration  = seconds() - startTime;
+  printf("    memcpy + CRC : CRC=%08X, %.3fs, %.3f MB/s\n",
          crc, duration, (NumBytes / (1024*1024)) / duration);
 
+  startTime = seconds();
+  crc = crc32_copy(copy, data, NumBytes);
+  duration  = seconds() - startTime;
+  printf("    copy         : CRC=%08X, %.3fs, %.3f MB/s\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration);
+
+  startTime = seconds();
+  crc = crc32_copy(copy, data, NumBytes, 0, true);
+  duration  = seconds() - startTime;
+  printf("    copy         : CRC=%08X, %.3fs, %.3f MB/s (non-temporal)\n",
+         crc, duration, (NumBytes / (1024*1024)) / duration);
+  delete[] copy;
+
+#ifdef CRC32_TEST_ALIGNMENT
+  // same number of bytes starting at every offset of a cache line
+  printf("alignment        : MB/s for each offset 0..63\n");
+  for (size_t offset = 0; offset < 64; offset++)
+  {
+    const char* start = data + offset;
+    uint32_t expected = crc32_fast(start, AlignmentTestSize);
+    printf("  offset %2d       :", int(offset));
+
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
+    startTime = seconds();
+    crc = crc32_4bytes(start, AlignmentTestSize);
+    duration  = seconds() - startTime;
+    printf("  4 bytes %7.1f%s", (AlignmentTestSize / (1024*1024)) / duration, crc == expected ? "" : " ERROR");
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
+    startTime = seconds();
+    crc = crc32_8bytes(start, AlignmentTestSize);
+    duration  = seconds() - startTime;
+    printf("  8 bytes %7.1f%s", (AlignmentTestSize / (1024*1024)) / duration, crc == expected ? "" : " ERROR");
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+    startTime = seconds();
+    crc = crc32_16bytes(start, AlignmentTestSize);
+    duration  = seconds() - startTime;
+    printf("  16 bytes %7.1f%s", (AlignmentTestSize / (1024*1024)) / duration, crc == expected ? "" : " ERROR");
+#endif
+#ifdef CRC32_USE_PCLMULQDQ
+    if (crc32_pclmul_supported())
+    {
+      startTime = seconds();
+      crc = crc32_pclmul(start, AlignmentTestSize);
+      duration  = seconds() - startTime;
+      printf("  carry-less %7.1f%s", (AlignmentTestSize / (1024*1024)) / duration, crc == expected ? "" : " ERROR");
+    }
+#endif
+    printf("\n");
+  }
+#endif // CRC32_TEST_ALIGNMENT
+
   delete[] data;
   return 0;
 }
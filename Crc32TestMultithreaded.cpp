@@ -4,16 +4,18 @@
 // see http://create.stephan-brumme.com/disclaimer.html
 //
 
-#include "Crc32.h"
+#include "Crc32Parallel.h"
+#include "Crc32Index.h"
+#include "Crc32Chunker.h"
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 
 #include <vector>
 #include <string>
 
 // C++11 multithreading
 #include <thread>
-#include <future>
 
 // //////////////////////////////////////////////////////////
 // test code
@@ -45,37 +47,10 @@ static double seconds()
 
 // //////////////////////////////////////////////////////////
 // run a CRC32 algorithm on multiple threads
-typedef uint32_t (*Crc32Algorithm)(const void* data, size_t length, uint32_t previousCrc32);
-// compute CRC32 of up to maxBlockSize bytes and start recursively a new thread for excess data
-uint32_t asyncCrc32(Crc32Algorithm myCrc32, const void* data, size_t numBytes, size_t maxBlockSize)
+// call: run(crc32_8bytes, data, NumBytes, pool)
+uint32_t run(Crc32Function myCrc32, const void* data, size_t numBytes, Crc32ThreadPool& pool)
 {
-  // last block ?
-  if (numBytes <= maxBlockSize)
-    return myCrc32(data, numBytes, 0); // we're done
-
-  // compute CRC of the remaining bytes in a separate thread
-  auto dataLeft  = (const char*)data + maxBlockSize;
-  auto bytesLeft =          numBytes - maxBlockSize;
-  auto remainder = std::async(std::launch::async, asyncCrc32, myCrc32, dataLeft, bytesLeft, maxBlockSize);
-
-  // compute CRC of the current block
-  auto currentCrc   = myCrc32(data, maxBlockSize, 0);
-  // get CRC of the remainder
-  auto remainderCrc = remainder.get();
-  // and merge both
-  return crc32_combine(currentCrc, remainderCrc, bytesLeft);
-}
-// call: run(crc32_8bytes, data, NumBytes, 8) if you have an octocore CPU
-uint32_t run(Crc32Algorithm myCrc32, const void* data, size_t numBytes, size_t numThreads = 0)
-{
-  // run on all cores
-  if (numThreads == 0)
-    numThreads = std::thread::hardware_concurrency();
-
-  // split data evenly, rounding up
-  auto defaultBlocksize = (numBytes + numThreads - 1) / numThreads;
-
-  return asyncCrc32(myCrc32, data, numBytes, defaultBlocksize);
+  return crc32_parallel(data, numBytes, 0, &pool, myCrc32);
 }
 
 
@@ -99,17 +74,223 @@ bool testCombine(const char* data, size_t maxBytes = 1024)
 
     // CRC using the new crc32_combine function
     auto crcCombined   = crc32_combine(crcA, crcB, lengthB);
+    // same with a precomputed shift
+    auto crcShifted    = Crc32Shift(lengthB).combine(crcA, crcB);
 
     // check results
-    if (crcAtOnce != crcSequential || crcAtOnce != crcCombined)
+    if (crcAtOnce != crcSequential || crcAtOnce != crcCombined || crcAtOnce != crcShifted)
+    {
+      printf("FAILED @ %d: %08X %08X %08X %08X %08X %08X\n", int(lengthA), crcA, crcB, crcAtOnce, crcSequential, crcCombined, crcShifted);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// compare crc32_zeros against processing a buffer full of zeros
+bool testZeros(size_t maxBytes = 100000)
+{
+  std::vector<char> zeros(maxBytes, 0);
+
+  bool ok = true;
+  for (size_t numBytes = 0; numBytes < maxBytes; numBytes = numBytes * 3 / 2 + 1)
+  {
+    auto crcZeros   = crc32_zeros(0x12345678, numBytes);
+    auto crcProcess = crc32_1byte(zeros.data(), numBytes, 0x12345678);
+    if (crcZeros != crcProcess)
+    {
+      printf("FAILED @ %d: %08X %08X\n", int(numBytes), crcZeros, crcProcess);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// patch a few bytes and compare crc32_update_range against a full computation
+bool testUpdateRange(const char* data, size_t maxBytes = 1024)
+{
+  std::vector<char> patched(data, data + maxBytes);
+  auto crcOld = crc32_1byte(data, maxBytes);
+
+  bool ok = true;
+  for (size_t offset = 0; offset < maxBytes; offset += 7)
+  {
+    auto length = (offset * 13) % (maxBytes - offset + 1);
+
+    // invert the bytes of the range
+    for (size_t i = offset; i < offset + length; i++)
+      patched[i] = char(~data[i]);
+
+    auto crcNew     = crc32_1byte(patched.data(), maxBytes);
+    auto crcUpdated = crc32_update_range(crcOld, maxBytes, offset, data + offset, patched.data() + offset, length);
+    if (crcNew != crcUpdated)
+    {
+      printf("FAILED @ %d+%d: %08X %08X\n", int(offset), int(length), crcNew, crcUpdated);
+      ok = false;
+    }
+
+    // restore
+    for (size_t i = offset; i < offset + length; i++)
+      patched[i] = data[i];
+  }
+  return ok;
+}
+
+// slide a window over the data, compare each window's CRC32 against a full computation
+bool testRolling(const char* data, size_t windowSize, size_t maxBytes = 10000)
+{
+  Crc32Rolling rolling(windowSize);
+  bool ok = rolling.reset(data) == crc32_1byte(data, windowSize);
+  for (size_t i = 1; i + windowSize <= maxBytes; i++)
+    if (rolling.roll(uint8_t(data[i - 1]), uint8_t(data[i + windowSize - 1])) != crc32_1byte(data + i, windowSize))
+    {
+      printf("FAILED @ %d (window %d)\n", int(i), int(windowSize));
+      return false;
+    }
+  return ok;
+}
+
+// split data into chunks, check their sizes and CRC32s, most chunks must survive an inserted byte
+bool testChunker(size_t maxBytes = 1024*1024)
+{
+  // the global test data repeats every 256 bytes (lowest bits of an LCG) => no boundaries at all
+  std::vector<char> random(maxBytes);
+  uint32_t randomNumber = 0x27121978;
+  for (auto& x : random)
+  {
+    x = char(randomNumber >> 24);
+    randomNumber = 1664525 * randomNumber + 1013904223;
+  }
+  const char* data = random.data();
+
+  Crc32Chunker chunker(1024, 4096, 16384);
+  auto chunks = chunker.split(data, maxBytes);
+
+  bool ok = true;
+  size_t offset = 0;
+  for (auto& chunk : chunks)
+  {
+    bool isLast = chunk.offset + chunk.length == maxBytes;
+    if (chunk.offset != offset || chunk.length > chunker.getMaxSize() || (chunk.length < chunker.getMinSize() && !isLast) ||
+        chunk.crc32 != crc32_1byte(data + chunk.offset, chunk.length))
     {
-      printf("FAILED @ %d: %08X %08X %08X %08X %08X\n", lengthA, crcA, crcB, crcAtOnce, crcSequential, crcCombined);
+      printf("FAILED @ %d (%d bytes)\n", int(chunk.offset), int(chunk.length));
       ok = false;
     }
+    offset += chunk.length;
   }
+  ok = ok && offset == maxBytes;
+
+  // insert a byte in the middle
+  std::vector<char> modified(data, data + maxBytes);
+  modified.insert(modified.begin() + maxBytes / 2, 'x');
+  auto modifiedChunks = chunker.split(modified.data(), modified.size());
+
+  // count unchanged chunks (same CRC32 and length)
+  size_t same = 0;
+  for (auto& chunk : modifiedChunks)
+    for (auto& original : chunks)
+      if (chunk.crc32 == original.crc32 && chunk.length == original.length)
+      {
+        same++;
+        break;
+      }
+  if (same + 3 < chunks.size())
+  {
+    printf("FAILED: only %d of %d chunks unchanged\n", int(same), int(chunks.size()));
+    ok = false;
+  }
+
+  return ok;
+}
+
+// CRC32 of ranges based on a block index, find a corrupted byte, save and load the index
+bool testIndex(const char* data, size_t maxBytes = 100000, size_t blockSize = 1000)
+{
+  Crc32Index index(blockSize);
+  // add data in odd chunks
+  for (size_t i = 0; i < maxBytes; i += 777)
+    index.append(data + i, (maxBytes - i < 777) ? maxBytes - i : 777);
+
+  bool ok = index.crc32() == crc32_1byte(data, maxBytes);
+  for (size_t begin = 0; begin < maxBytes; begin += 997)
+    for (size_t end = begin; end <= maxBytes; end += 2345)
+      if (index.crc32(begin, end, data + begin) != crc32_1byte(data + begin, end - begin))
+      {
+        printf("FAILED @ %d..%d\n", int(begin), int(end));
+        ok = false;
+      }
+
+  // up to the end of the data (the last block may be incomplete) and beyond
+  for (size_t begin = 0; begin < maxBytes; begin += 997)
+    if (index.crc32(begin, maxBytes,     data + begin) != crc32_1byte(data + begin, maxBytes - begin) ||
+        index.crc32(begin, maxBytes + 1, data + begin) != crc32_1byte(data + begin, maxBytes - begin))
+    {
+      printf("FAILED @ %d..end\n", int(begin));
+      ok = false;
+    }
+
+  // flip a single bit
+  std::vector<char> corrupted(data, data + maxBytes);
+  corrupted[maxBytes / 2] ^= 1;
+  auto corrupt = index.findCorruptBlocks(corrupted.data(), maxBytes);
+  if (corrupt.size() != 1 || corrupt[0] != (maxBytes / 2) / blockSize)
+    ok = false;
+
+  // store in a temporary file
+  const char* filename = "Crc32TestMultithreaded.idx";
+  Crc32Index loaded;
+  ok = ok && index.save(filename) && loaded.load(filename);
+  remove(filename);
+  if (!ok || loaded.getNumBlocks() != index.getNumBlocks() || loaded.crc32() != index.crc32() ||
+      loaded.crc32(123, maxBytes - 456, data + 123) != crc32_1byte(data + 123, maxBytes - 456 - 123))
+    ok = false;
+
   return ok;
 }
 
+#ifdef CRC32_USE_PROFILE
+// crc32_fast and crc32_parallel with a profile, saved and loaded again
+bool testProfile(const char* data, size_t maxBytes = 1024*1024)
+{
+  Crc32Profile original = crc32_get_profile();
+
+  // a different algorithm per size class, many small tasks (4 threads even on single-core CPUs)
+  Crc32Profile profile = { { "halfbyte", "16bytes_prefetch", "8bytes", "1byte" }, 128, 64*1024, 1000 };
+  crc32_set_profile(profile);
+  Crc32ThreadPool pool(4);
+
+  bool ok = pool.getMinBlockSize() == 1000;
+  for (size_t length = 0; length <= maxBytes; length = 3 * length + 1)
+    if (crc32_fast(data, length, 0x12345678) != crc32_1byte(data, length, 0x12345678))
+    {
+      printf("FAILED @ %d bytes\n", int(length));
+      ok = false;
+    }
+  if (crc32_parallel(data, maxBytes - 12345, 0x12345678, &pool) != crc32_1byte(data, maxBytes - 12345, 0x12345678))
+    ok = false;
+
+  // store in a temporary file, unknown algorithms fall back to the built-in choice
+  const char* filename = "Crc32TestMultithreaded.profile";
+  profile.algorithms[0] = "no_such_algorithm";
+  crc32_set_profile(original);
+  ok = ok && crc32_save_profile(filename, profile) && crc32_load_profile(filename);
+  remove(filename);
+  Crc32Profile loaded = crc32_get_profile();
+  if (!ok || loaded.algorithms[0] != NULL || strcmp(loaded.algorithms[3], "1byte") != 0 ||
+      loaded.prefetchAhead != 128 || loaded.parallelBlockSize != 64*1024 || loaded.parallelMinBlockSize != 1000)
+    ok = false;
+
+  // missing file => unchanged
+  if (crc32_load_profile(filename))
+    ok = false;
+
+  crc32_set_profile(original);
+  return ok;
+}
+#endif
+
 
 int main(int argc, char* argv[])
 {
@@ -129,7 +310,6 @@ int main(int argc, char* argv[])
   // re-use variables
   double startTime, duration;
   uint32_t crc;
-  std::vector<std::future<uint32_t>> futures;
 
   // number of threads: use all cores by default or set number as command-line parameter
   auto numThreads = 0;
@@ -139,38 +319,41 @@ int main(int argc, char* argv[])
     numThreads = std::thread::hardware_concurrency();
   printf("use %d threads:\n", numThreads);
 
+  // worker threads are created only once
+  Crc32ThreadPool pool(numThreads);
+
   // //////////////////////////////////////////////////////////
   // one byte at once
   startTime = seconds();
-  crc = run(crc32_1byte, data, NumBytes, numThreads);
+  crc = run(crc32_1byte, data, NumBytes, pool);
   duration  = seconds() - startTime;
   printf("  1 byte  at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
          numThreads, crc, duration, (NumBytes / (1024*1024)) / duration);
 
   // four bytes at once
   startTime = seconds();
-  crc = run(crc32_4bytes, data, NumBytes, numThreads);
+  crc = run(crc32_4bytes, data, NumBytes, pool);
   duration  = seconds() - startTime;
   printf("  4 bytes at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
          numThreads, crc, duration, (NumBytes / (1024*1024)) / duration);
 
   // eight bytes at once
   startTime = seconds();
-  crc = run(crc32_8bytes, data, NumBytes, numThreads);
+  crc = run(crc32_8bytes, data, NumBytes, pool);
   duration  = seconds() - startTime;
   printf("  8 bytes at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
          numThreads, crc, duration, (NumBytes / (1024*1024)) / duration);
 
   // eight bytes at once, unrolled 4 times (=> 32 bytes per loop)
   startTime = seconds();
-  crc = run(crc32_4x8bytes, data, NumBytes, numThreads);
+  crc = run(crc32_4x8bytes, data, NumBytes, pool);
   duration  = seconds() - startTime;
   printf("4x8 bytes at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
          numThreads, crc, duration, (NumBytes / (1024*1024)) / duration);
 
   // sixteen bytes at once
   startTime = seconds();
-  crc = run(crc32_16bytes, data, NumBytes, numThreads);
+  crc = run(crc32_16bytes, data, NumBytes, pool);
   duration  = seconds() - startTime;
   printf(" 16 bytes at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
          numThreads, crc, duration, (NumBytes / (1024*1024)) / duration);
@@ -180,13 +363,14 @@ int main(int argc, char* argv[])
   printf("run slicing-by-8 algorithm with 1 to %d threads:\n", numThreads);
   for (auto scaleThreads = 1; scaleThreads <= numThreads; scaleThreads++)
   {
-    // eight bytes at once
+    // eight bytes at once, threads are created before measuring
+    Crc32ThreadPool scalePool(scaleThreads);
     startTime = seconds();
 
     if (scaleThreads == 1)
       crc =     crc32_8bytes (data, NumBytes); // single-threaded
     else
-      crc = run(crc32_8bytes, data, NumBytes, scaleThreads); // multi-threaded
+      crc = run(crc32_8bytes, data, NumBytes, scalePool); // multi-threaded
 
     duration  = seconds() - startTime;
     printf("  8 bytes at once / %d threads: CRC=%08X, %.3fs, %.3f MB/s\n",
@@ -198,6 +382,38 @@ int main(int argc, char* argv[])
   if (!testCombine(data, 1024))
     printf("ERROR in crc32_combine !!!\n");
 
+  // verify crc32_zeros
+  if (!testZeros())
+    printf("ERROR in crc32_zeros !!!\n");
+
+  // verify Crc32Rolling
+  if (!testRolling(data, 1) || !testRolling(data, 16) || !testRolling(data, 48) || !testRolling(data, 4096))
+    printf("ERROR in Crc32Rolling !!!\n");
+
+  // verify Crc32Chunker
+  if (!testChunker())
+    printf("ERROR in Crc32Chunker !!!\n");
+
+  // verify Crc32Index
+  if (!testIndex(data) || !testIndex(data, 100000, 64*1024) || !testIndex(data, 100000, 3000) || !testIndex(data, 3000, 1000))
+    printf("ERROR in Crc32Index !!!\n");
+
+  // verify crc32_update_range
+  if (!testUpdateRange(data, 1024) || !testUpdateRange(data, 100000))
+    printf("ERROR in crc32_update_range !!!\n");
+
+#ifdef CRC32_USE_PROFILE
+  // verify Crc32Profile
+  if (!testProfile(data))
+    printf("ERROR in Crc32Profile !!!\n");
+#endif
+
+  // verify crc32_parallel with an odd number of bytes and a previous CRC
+  pool.setMinBlockSize(1000);
+  auto oddBytes = NumBytes - 12345;
+  if (crc32_parallel(data, oddBytes, 0x12345678, &pool) != crc32_fast(data, oddBytes, 0x12345678))
+    printf("ERROR in crc32_parallel !!!\n");
+
   delete[] data;
   return 0;
 }